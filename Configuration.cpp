@@ -2,7 +2,9 @@
 #include <ArduinoJson.h>
 #include <Timezone.h>
 #include "Configuration.h"
+#include "state.h"
 #include "dbg.h"
+#include "arena.h"
 
 bool Configuration::read_file(const char *filename) {
 	File f = LittleFS.open(filename, "r");
@@ -12,15 +14,33 @@ bool Configuration::read_file(const char *filename) {
 		return false;
 	}
 
-	JsonDocument doc;
+	json_arena.reset();
+	JsonDocument doc(&json_arena);
 	auto error = deserializeJson(doc, f);
 	f.close();
+	if (error == DeserializationError::NoMemory || doc.overflowed()) {
+		ERR(print(F("too big: ")));
+		ERR(println(filename));
+		stats.mem_failures++;
+		return false;
+	}
+	if (error) {
+		ERR(println(error.c_str()));
+		return false;
+	}
+
+	configure(doc);
+	return true;
+}
+
+bool Configuration::read_json(const String &json) {
+	JsonDocument doc;
+	auto error = deserializeJson(doc, json);
 	if (error) {
 		ERR(println(error.c_str()));
 		return false;
 	}
 
-	JsonObject root = doc.as<JsonObject>();
 	configure(doc);
 	return true;
 }
@@ -32,8 +52,12 @@ void config::configure(JsonDocument &o) {
 	strlcpy(key, o[F("key")] | "", sizeof(key));
 	strlcpy(station, o[F("station")] | "", sizeof(station));
 	strlcpy(hostname, o[F("hostname")] | "", sizeof(hostname));
+	strlcpy(server, o[F("server")] | "", sizeof(server));
+	server_port = o[F("server_port")] | 80;
 	conditions_interval = 1000 * (int)o[F("conditions_interval")];
 	forecasts_interval = 1000 * (int)o[F("forecasts_interval")];
+	combine_window = 1000 * (int)o[F("combine_window")];
+	retry_interval = 1000 * ((int)o[F("retry_interval")] | 300);
 	metric = o[F("metric")];
 	dimmable = o[F("dimmable")];
 	nearest = o[F("nearest")];
@@ -58,3 +82,73 @@ void config::configure(JsonDocument &o) {
 	winter.hour = (int)w[F("hour")] | 0;
 	winter.offset = (int)w[F("offset")] | 0;
 }
+
+static bool rule_changed(const TimeChangeRule &a, const TimeChangeRule &b) {
+	return a.week != b.week || a.dow != b.dow || a.month != b.month || a.hour != b.hour || a.offset != b.offset;
+}
+
+uint32_t config::changes(const config &o) const {
+	uint32_t c = 0;
+	if (strcmp(ssid, o.ssid))
+		c |= bit(CFG_SSID);
+	if (strcmp(password, o.password))
+		c |= bit(CFG_PASSWORD);
+	if (strcmp(hostname, o.hostname))
+		c |= bit(CFG_HOSTNAME);
+	if (strcmp(key, o.key))
+		c |= bit(CFG_KEY);
+	if (strcmp(station, o.station))
+		c |= bit(CFG_STATION);
+	if (nearest != o.nearest)
+		c |= bit(CFG_NEAREST);
+	if (metric != o.metric)
+		c |= bit(CFG_METRIC);
+	if (dimmable != o.dimmable)
+		c |= bit(CFG_DIMMABLE);
+	if (conditions_interval != o.conditions_interval)
+		c |= bit(CFG_CONDITIONS_INTERVAL);
+	if (forecasts_interval != o.forecasts_interval)
+		c |= bit(CFG_FORECASTS_INTERVAL);
+	if (combine_window != o.combine_window)
+		c |= bit(CFG_COMBINE_WINDOW);
+	if (retry_interval != o.retry_interval)
+		c |= bit(CFG_RETRY_INTERVAL);
+	if (on_time != o.on_time)
+		c |= bit(CFG_DISPLAY);
+	if (bright != o.bright)
+		c |= bit(CFG_BRIGHT);
+	if (dim != o.dim)
+		c |= bit(CFG_DIM);
+	if (rotate != o.rotate)
+		c |= bit(CFG_ROTATE);
+	if (rule_changed(summer, o.summer) || rule_changed(winter, o.winter))
+		c |= bit(CFG_TIMEZONE);
+	if (strcmp(server, o.server) || server_port != o.server_port)
+		c |= bit(CFG_SERVER);
+	return c;
+}
+
+// as in the config file
+const __FlashStringHelper *config::setting_name(int s) {
+	switch (s) {
+	case CFG_SSID: return F("ssid");
+	case CFG_PASSWORD: return F("password");
+	case CFG_HOSTNAME: return F("hostname");
+	case CFG_KEY: return F("key");
+	case CFG_STATION: return F("station");
+	case CFG_NEAREST: return F("nearest");
+	case CFG_METRIC: return F("metric");
+	case CFG_DIMMABLE: return F("dimmable");
+	case CFG_CONDITIONS_INTERVAL: return F("conditions_interval");
+	case CFG_FORECASTS_INTERVAL: return F("forecasts_interval");
+	case CFG_COMBINE_WINDOW: return F("combine_window");
+	case CFG_RETRY_INTERVAL: return F("retry_interval");
+	case CFG_DISPLAY: return F("display");
+	case CFG_BRIGHT: return F("bright");
+	case CFG_DIM: return F("dim");
+	case CFG_ROTATE: return F("rotate");
+	case CFG_TIMEZONE: return F("timezone");
+	case CFG_SERVER: return F("server");
+	}
+	return F("");
+}
@@ -3,11 +3,22 @@
 class Configuration {
 public:
 	bool read_file(const char *filename);
+	bool read_json(const String &json);
 
 protected:	
 	virtual void configure(class JsonDocument &doc) = 0;
 };
 
+// settings, as bits in the mask returned by config::changes()
+enum setting {
+	CFG_SSID, CFG_PASSWORD, CFG_HOSTNAME, CFG_KEY, CFG_STATION, CFG_NEAREST, CFG_METRIC, CFG_DIMMABLE,
+	CFG_CONDITIONS_INTERVAL, CFG_FORECASTS_INTERVAL, CFG_COMBINE_WINDOW, CFG_RETRY_INTERVAL,
+	CFG_DISPLAY, CFG_BRIGHT, CFG_DIM, CFG_ROTATE, CFG_TIMEZONE, CFG_SERVER, CFG_SETTINGS
+};
+
+// changing these needs a restart, the rest are applied live
+#define RESTART_SETTINGS	(bit(CFG_SSID) | bit(CFG_PASSWORD) | bit(CFG_HOSTNAME) | bit(CFG_SERVER))
+
 class config: public Configuration {
 public:
 	char ssid[33];
@@ -15,8 +26,10 @@ public:
 	char key[33];
 	char station[33];
 	char hostname[17];
+	char server[33];	// if set, every request goes here instead, e.g. to tools/replayd.py
+	uint16_t server_port;
 	bool metric, dimmable, nearest;
-	uint32_t conditions_interval, forecasts_interval;
+	uint32_t conditions_interval, forecasts_interval, combine_window;
 	uint32_t on_time, retry_interval;
 	uint16_t bright, dim;
 	uint8_t rotate;
@@ -25,6 +38,10 @@ public:
 	TimeChangeRule summer, winter;
 
 	void configure(class JsonDocument &doc);
+
+	// which settings differ from the other configuration's
+	uint32_t changes(const config &o) const;
+	static const __FlashStringHelper *setting_name(int s);
 };
 
 extern config cfg;
@@ -2,7 +2,7 @@
 
 class Switch {
 public:
-	Switch(unsigned millis): _millis(millis) {}
+	Switch(unsigned millis): _millis(millis), _reset(0), _on(false) {}
 
 	operator bool() {
 		bool on = _on;
@@ -15,7 +15,8 @@ public:
 
 	void on() {
 		unsigned now = millis();
-		if (now > _reset + _millis) {
+		// unsigned, so it's right across millis() wrapping
+		if (now - _reset > _millis) {
 			_on = true;
 		}
 	}
@@ -18,6 +18,9 @@
 #include "display.h"
 #include "dbg.h"
 #include "providers.h"
+#include "snapshot.h"
+#include "fastconnect.h"
+#include "arena.h"
 
 #if !defined(TFT_LED)
 #define TFT_LED	D2
@@ -27,6 +30,13 @@
 #define SWITCH	D3
 #endif
 
+// seconds: after a new observation is due, and before the first retry
+#define JITTER	30
+#define BACKOFF	15
+
+// ms, between checks on the age of the cached location
+#define LOCATION_CHECK	3600000
+
 TFT_eSPI tft;
 MDNSResponder mdns;
 ESP8266WebServer server(80);
@@ -55,12 +65,24 @@ void IRAM_ATTR swtch_handler() { swtch.on(); }
 const char *config_file = "/config.json";
 static int screen = 0;
 static SimpleTimer timers;
-
-static void update_display() {
+static int conditions_timer = -1, forecasts_timer = -1;
+static uint32_t conditions_due, forecasts_due;
+static unsigned conditions_retries, forecasts_retries;
+static unsigned prefetching = sizeof(forecasts)/sizeof(forecasts[0]);
+static uint8_t fetching, queued;	// in progress, and waiting for it
+static bool located = true;	// whether the weather can be fetched
+static unsigned location_retries;
+static float lat, lon;		// where it was last fetched for
+
+static void update_display(bool refresh = false) {
 	if (cfg.dimmable || fade > cfg.dim) {
+		uint32_t start = millis();
 		switch (screen) {
 		case 0:
-			display_weather(conditions);
+			if (refresh)
+				refresh_weather(conditions);
+			else
+				display_weather(conditions);
 			break;
 		case 1:
 			display_astronomy(conditions);
@@ -75,22 +97,331 @@ static void update_display() {
 			display_about(stats);
 			break;
 		}
+		stats.paint_ms[screen] = millis() - start;
+		DBG(print(F("Painted in ")));
+		DBG(print(stats.paint_ms[screen]));
+		DBG(println(F(" ms")));
+	}
+}
+
+// whether a pending update is due within the window for combining it with another
+static bool due_soon(int timer, uint32_t due) {
+	return provider.combines() && timer >= 0 && (int32_t)(due - millis()) <= (int32_t)cfg.combine_window;
+}
+
+static void cancel(int &timer) {
+	if (timer >= 0)
+		timers.deleteTimer(timer);
+	timer = -1;
+}
+
+static void schedule(int &timer, uint32_t &due, uint32_t delay, void (*update)()) {
+	cancel(timer);
+	due = millis() + delay;
+	timer = timers.setTimeout(delay, update);
+}
+
+// doubling from BACKOFF up to retry_interval
+static uint32_t backoff(unsigned &retries) {
+	uint32_t delay = (1000 * BACKOFF) << min(retries, 10u);
+	retries++;
+	return min(delay, cfg.retry_interval);
+}
+
+// not before the response goes stale
+static uint32_t fresh(uint32_t delay) {
+	long max_age = provider.max_age();
+	return max_age > 0 && 1000 * (uint32_t)max_age > delay? 1000 * max_age: delay;
+}
+
+// aligned to the last observation published within the interval, if the provider says when
+static uint32_t conditions_delay(uint8_t updated) {
+	if (updated & FETCH_FAILED)
+		return backoff(conditions_retries);
+
+	time_t now = time(0);
+	if (!conditions.interval || now < 1600000000) {
+		conditions_retries = 0;
+		return fresh(cfg.conditions_interval);
 	}
+
+	time_t due = now + cfg.conditions_interval / 1000;
+	long n = (due - conditions.epoch) / conditions.interval;
+	time_t next = conditions.epoch + max(n, 1L) * conditions.interval;
+	if (next <= now)
+		// it's late
+		return backoff(conditions_retries);
+
+	conditions_retries = 0;
+	return fresh(1000 * (next - now + random(JITTER)));
+}
+
+static uint32_t forecasts_delay(uint8_t updated) {
+	if (updated & FETCH_FAILED)
+		return backoff(forecasts_retries);
+
+	forecasts_retries = 0;
+	return fresh(cfg.forecasts_interval);
+}
+
+static void update_conditions();
+static void update_forecasts();
+static void update_both();
+static void locate();
+
+static void fetched(uint8_t what, uint8_t updated) {
+	// what's shown is current even if it was restored and hasn't changed since
+	bool was_stale = conditions.stale;
+	if ((what & FETCH_CONDITIONS) && !(updated & FETCH_FAILED))
+		conditions.stale = false;
+
+	if ((updated & (FETCH_CONDITIONS | FETCH_LOCATION)) || was_stale != conditions.stale) {
+		update_display(true);
+		if (!stats.first_frame_ms)
+			stats.first_frame_ms = millis();
+	}
+	if (updated & FETCH_CONDITIONS)
+		stats.last_fetch_conditions = millis();
+	if (updated & FETCH_FORECASTS) {
+		stats.last_fetch_forecasts = millis();
+		prefetching = 0;
+	}
+	if (updated & (FETCH_CONDITIONS | FETCH_FORECASTS))
+		save_snapshot(conditions, forecasts, sizeof(forecasts)/sizeof(forecasts[0]), stats);
+	if (updated & FETCH_LOCATION) {
+		// the weather's fetched again if it was held for this, or it moved
+		bool held = !located;
+		located = true;
+		location_retries = 0;
+		if (held || cfg.lat != lat || cfg.lon != lon)
+			update_both();
+	} else if ((what & FETCH_LOCATION) && !located)
+		timers.setTimeout(backoff(location_retries), locate);
+
+	if (what & FETCH_CONDITIONS) {
+		schedule(conditions_timer, conditions_due, conditions_delay(updated), update_conditions);
+		DBG(print(F("Next conditions in ")));
+		DBG(println(conditions_due - millis()));
+	}
+	if (what & FETCH_FORECASTS) {
+		schedule(forecasts_timer, forecasts_due, forecasts_delay(updated), update_forecasts);
+		DBG(print(F("Next forecasts in ")));
+		DBG(println(forecasts_due - millis()));
+	}
+}
+
+// fetches run in the background, one at a time, and are rescheduled when done
+static void fetch(uint8_t what) {
+	// the weather waits until there's a location to fetch it for
+	if (!located)
+		what &= FETCH_LOCATION;
+	if (!what)
+		return;
+	if (provider.fetching())
+		queued |= what;
+	else if (provider.fetch(what))
+		fetching = what;
+	else {
+		ERR(println(F("Failed to start fetch")));
+		fetched(what, FETCH_FAILED);
+	}
+}
+
+static void update_all() {
+	DBG(println(F("Updating conditions and forecasts...")));
+	fetch(FETCH_CONDITIONS | FETCH_FORECASTS);
 }
 
 // timer callbacks
+static void check_location() {
+	if (provider.location_stale()) {
+		DBG(println(F("Updating location...")));
+		fetch(FETCH_LOCATION);
+	}
+}
+
+static void locate() {
+	DBG(println(F("Looking up location...")));
+	fetch(FETCH_LOCATION);
+}
+
 static void update_conditions() {
-	DBG(println(F("Updating conditions...")));
-	if (provider.fetch_conditions(conditions)) {
-		update_display();
-		stats.last_fetch_conditions = millis();
+	conditions_timer = -1;
+	if (due_soon(forecasts_timer, forecasts_due)) {
+		cancel(forecasts_timer);
+		update_all();
+		return;
 	}
+
+	DBG(println(F("Updating conditions...")));
+	fetch(FETCH_CONDITIONS);
 }
 
 static void update_forecasts() {
+	forecasts_timer = -1;
+	if (due_soon(conditions_timer, conditions_due)) {
+		cancel(conditions_timer);
+		update_all();
+		return;
+	}
+
 	DBG(println(F("Updating forecasts...")));
-	if (provider.fetch_forecasts(&forecasts[0], sizeof(forecasts)/sizeof(forecasts[0])))
-		stats.last_fetch_forecasts = millis();
+	fetch(FETCH_FORECASTS);
+}
+
+static void update_both() {
+	lat = cfg.lat;
+	lon = cfg.lon;
+	queued &= ~(FETCH_CONDITIONS | FETCH_FORECASTS);
+	cancel(conditions_timer);
+	cancel(forecasts_timer);
+	if (provider.combines())
+		update_all();
+	else {
+		update_conditions();
+		update_forecasts();
+	}
+}
+
+// a shorter interval takes effect now, a longer one after the next fetch
+static void shorten(int &timer, uint32_t &due, uint32_t interval, void (*update)()) {
+	if (timer >= 0 && (int32_t)(due - millis()) > (int32_t)interval)
+		schedule(timer, due, interval, update);
+}
+
+// so the next observation replaces what's shown, however old it is
+static void forget_epochs() {
+	conditions.epoch = 0;
+	for (unsigned i = 0; i < sizeof(forecasts)/sizeof(forecasts[0]); i++)
+		forecasts[i].epoch = 0;
+}
+
+// the intervals, combine window and display time are read when next needed
+static void apply_config(const config &old, uint32_t changed) {
+	if (changed & (bit(CFG_STATION) | bit(CFG_NEAREST))) {
+		forget_epochs();
+		if (provider.relocate(conditions))
+			update_both();
+		else {
+			located = false;
+			cancel(conditions_timer);
+			cancel(forecasts_timer);
+			queued &= ~(FETCH_CONDITIONS | FETCH_FORECASTS);
+			fetch(FETCH_LOCATION);
+		}
+	} else {
+		cfg.lat = old.lat;
+		cfg.lon = old.lon;
+		if (changed & (bit(CFG_METRIC) | bit(CFG_KEY))) {
+			// what's shown is in the old units until it's fetched again
+			conditions.stale = true;
+			discard_snapshot();
+			forget_epochs();
+			update_both();
+		}
+	}
+
+	if (changed & bit(CFG_TIMEZONE)) {
+		delete tz;
+		tz = new Timezone(cfg.summer, cfg.winter);
+	}
+	if (changed & (bit(CFG_BRIGHT) | bit(CFG_DIM) | bit(CFG_DIMMABLE))) {
+		fade = fade == old.dim? cfg.dim: cfg.bright;
+		analogWrite(TFT_LED, fade);
+	}
+	if (changed & bit(CFG_ROTATE))
+		tft.setRotation(cfg.rotate);
+	if (changed & bit(CFG_CONDITIONS_INTERVAL))
+		shorten(conditions_timer, conditions_due, cfg.conditions_interval, update_conditions);
+	if (changed & bit(CFG_FORECASTS_INTERVAL))
+		shorten(forecasts_timer, forecasts_due, cfg.forecasts_interval, update_forecasts);
+
+	if (changed & (bit(CFG_METRIC) | bit(CFG_ROTATE) | bit(CFG_TIMEZONE) | bit(CFG_DIMMABLE)))
+		update_display();
+}
+
+// only changes to the network identity need a restart
+static void post_config() {
+	if (!server.hasArg("plain")) {
+		server.send(400, "text/plain", "No body!");
+		return;
+	}
+
+	String body = server.arg("plain");
+	config old = cfg;
+	if (!cfg.read_json(body)) {
+		server.send(400, "text/plain", "Bad config!");
+		return;
+	}
+	File f = LittleFS.open(config_file, "w");
+	f.print(body);
+	f.close();
+
+	uint32_t changed = cfg.changes(old);
+	bool restart = !connected || (changed & RESTART_SETTINGS);
+	JsonDocument doc;
+	doc[F("restart")] = restart;
+	JsonArray live = doc[F("live")].to<JsonArray>();
+	if (!restart) {
+		apply_config(old, changed);
+		for (int s = 0; s < CFG_SETTINGS; s++)
+			if (changed & bit(s))
+				live.add(config::setting_name(s));
+	}
+
+	String response;
+	serializeJson(doc, response);
+	server.send(200, "application/json", response);
+	if (restart) {
+		discard_snapshot();
+		WiFi.setAutoConnect(false);
+		ESP.restart();
+	}
+}
+
+static void send_stats() {
+	JsonDocument doc;
+	doc[F("num_updates")] = stats.num_updates;
+	doc[F("last_age")] = stats.last_age;
+	doc[F("min_age")] = stats.min_age;
+	doc[F("max_age")] = stats.max_age;
+	doc[F("connect_failures")] = stats.connect_failures;
+	doc[F("http_requests")] = stats.http_requests;
+	doc[F("http_connects")] = stats.http_connects;
+	doc[F("rx_bytes")] = stats.rx_bytes;
+	doc[F("inflated_bytes")] = stats.inflated_bytes;
+	doc[F("inflate_us")] = stats.inflate_us;
+	doc[F("max_loop_ms")] = stats.max_loop_ms;
+	doc[F("first_frame_ms")] = stats.first_frame_ms;
+	doc[F("wifi_connect_ms")] = stats.wifi_connect_ms;
+	doc[F("wifi_fast")] = stats.wifi_fast;
+	doc[F("parse_failures")] = stats.parse_failures;
+	doc[F("mem_failures")] = stats.mem_failures;
+	doc[F("heap_conditions")] = stats.heap_conditions;
+	doc[F("heap_forecasts")] = stats.heap_forecasts;
+	doc[F("json_arena")] = json_arena.size();
+	doc[F("json_arena_peak")] = json_arena.peak();
+	doc[F("icon_hits")] = stats.icon_hits;
+	doc[F("icon_misses")] = stats.icon_misses;
+	doc[F("icon_evictions")] = stats.icon_evictions;
+	doc[F("icon_hit_rate")] = stats.icon_hit_rate();
+	JsonArray paint_ms = doc[F("paint_ms")].to<JsonArray>();
+	for (uint32_t ms: stats.paint_ms)
+		paint_ms.add(ms);
+	doc[F("free_heap")] = ESP.getFreeHeap();
+	doc[F("max_free_block")] = ESP.getMaxFreeBlockSize();
+
+	String body;
+	serializeJson(doc, body);
+	server.send(200, "application/json", body);
+}
+
+// redraws the clock at the start of each minute
+static void tick() {
+	if (cfg.dimmable || fade > cfg.dim)
+		refresh_time();
+	lease_check();
+	timers.setTimeout(1000 * (60 - time(0) % 60), tick);
 }
 
 static void next_fade() {
@@ -110,6 +441,46 @@ static void turn_off() {
 	}
 }
 
+static void show_config() {
+	tft.println(F("Weather Guy (c)2018-24"));
+	tft.print(F("ssid: "));
+	tft.println(cfg.ssid);
+	tft.print(F("password: "));
+	tft.println(cfg.password);
+	tft.print(F("key: "));
+	tft.println(cfg.key);
+	tft.print(F("station: "));
+	if (cfg.nearest)
+		tft.println(F("nearest"));
+	else
+		tft.println(cfg.station);
+	tft.print(F("hostname: "));
+	tft.println(cfg.hostname);
+	if (*cfg.server) {
+		tft.print(F("server: "));
+		tft.print(cfg.server);
+		tft.print(':');
+		tft.println(cfg.server_port);
+	}
+	tft.print(F("condition...: "));
+	tft.println(cfg.conditions_interval);
+	tft.print(F("forecast...: "));
+	tft.println(cfg.forecasts_interval);
+	tft.print(F("display: "));
+	tft.println(cfg.on_time);
+	tft.print(F("metric: "));
+	tft.println(cfg.metric);
+	if (cfg.dimmable) {
+		tft.print(F("bright: "));
+		tft.println(cfg.bright);
+		tft.print(F("dim: "));
+		tft.println(cfg.dim);
+	} else
+		tft.println(F("not dimmable"));
+	if (debug)
+		tft.println(F("DEBUG"));
+}
+
 void setup() {
 	Serial.begin(115200);
 	tft.init();
@@ -141,67 +512,32 @@ void setup() {
 
 	tft.fillScreen(TFT_BLACK);
 	tft.setRotation(cfg.rotate);
-	tft.println(F("Weather Guy (c)2018-24"));
-	tft.print(F("ssid: "));
-	tft.println(cfg.ssid);
-	tft.print(F("password: "));
-	tft.println(cfg.password);
-	tft.print(F("key: "));
-	tft.println(cfg.key);
-	tft.print(F("station: "));
-	if (cfg.nearest)
-		tft.println(F("nearest"));
-	else
-		tft.println(cfg.station);
-	tft.print(F("hostname: "));
-	tft.println(cfg.hostname);
-	tft.print(F("condition...: "));
-	tft.println(cfg.conditions_interval);
-	tft.print(F("forecast...: "));
-	tft.println(cfg.forecasts_interval);
-	tft.print(F("display: "));
-	tft.println(cfg.on_time);
-	tft.print(F("metric: "));
-	tft.println(cfg.metric);
-	if (cfg.dimmable) {
-		tft.print(F("bright: "));
-		tft.println(cfg.bright);
-		tft.print(F("dim: "));
-		tft.println(cfg.dim);
+	bool restored = restore_snapshot(conditions, forecasts, sizeof(forecasts)/sizeof(forecasts[0]), stats);
+	if (restored) {
+		update_display();
+		stats.first_frame_ms = millis();
 	} else
-		tft.println(F("not dimmable"));
-	if (debug)
-		tft.println(F("DEBUG"));
+		show_config();
 
 	WiFi.mode(WIFI_STA);
 	WiFi.setSleepMode(WIFI_NONE_SLEEP);
 	WiFi.hostname(cfg.hostname);
 	if (*cfg.ssid) {
 		WiFi.setAutoReconnect(true);
-		WiFi.begin(cfg.ssid, cfg.password);
 		const char busy[] = "|/-\\";
 		int16_t y = tft.getCursorY();
-		for (int i = 0; i < 60 && WiFi.status() != WL_CONNECTED; i++) {
-			delay(500);
-			char c = busy[i % 4];
-			tft.print(c);
-			tft.setCursor(0, y);
-		}
-		connected = WiFi.status() == WL_CONNECTED;
+		int i = 0;
+		connected = fast_connect(cfg.ssid, cfg.password, [&]() {
+			if (!restored) {
+				char c = busy[i++ % 4];
+				tft.print(c);
+				tft.setCursor(0, y);
+			}
+		});
 	}
 
-	server.on("/config", HTTP_POST, []() {
-		if (server.hasArg("plain")) {
-			String body = server.arg("plain");
-			File f = LittleFS.open(config_file, "w");
-			f.print(body);
-			f.close();
-			server.send(200);
-			WiFi.setAutoConnect(false);
-			ESP.restart();
-		} else
-			server.send(400, "text/plain", "No body!");
-	});
+	server.on("/config", HTTP_POST, post_config);
+	server.on("/stats", HTTP_GET, send_stats);
 	server.serveStatic("/", LittleFS, "/index.html");
 	server.serveStatic("/config", LittleFS, config_file);
 	server.serveStatic("/js/transparency.min.js", LittleFS, "/transparency.min.js");
@@ -219,6 +555,10 @@ void setup() {
 	if (!connected) {
 		WiFi.mode(WIFI_AP);
 		WiFi.softAP(cfg.hostname);
+		if (restored) {
+			tft.fillScreen(TFT_BLACK);
+			tft.setCursor(0, 0);
+		}
 		tft.println(F("Connect to SSID"));
 		tft.println(cfg.hostname);
 		tft.println(F("to configure WiFi"));
@@ -229,27 +569,35 @@ void setup() {
 		DBG(println(cfg.ssid));
 		DBG(println(WiFi.localIP()));
 
-		tft.println();
-		tft.print(F("http://"));
-		tft.print(WiFi.localIP());
-		tft.println('/');
+		if (!restored) {
+			tft.println();
+			tft.print(F("http://"));
+			tft.print(WiFi.localIP());
+			tft.println('/');
+		}
 
-		provider.begin();
+		configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+		located = provider.begin();
 
 		stats.last_fetch_conditions = -cfg.conditions_interval;
 		stats.last_fetch_forecasts = -cfg.forecasts_interval;
 	}
 	attachInterrupt(SWITCH, swtch_handler, FALLING);
 
-	timers.setInterval(cfg.conditions_interval, update_conditions);
-	timers.setInterval(cfg.forecasts_interval, update_forecasts);
 	timers.setTimeout(cfg.on_time, turn_off);
+	timers.setInterval(LOCATION_CHECK, check_location);
 
-	update_conditions();
-	update_forecasts();
+	// each update schedules the next when it's done, once there's a location
+	if (located)
+		update_both();
+	else
+		timers.setTimeout(backoff(location_retries), locate);
+	tick();
 }
 
 void loop() {
+	uint32_t start = millis();
+	bool busy = provider.fetching();
 	mdns.update();
 
 	server.handleClient();
@@ -273,6 +621,25 @@ void loop() {
 				screen++;
 			update_display();
 		}
+	} else if (prefetching < sizeof(forecasts)/sizeof(forecasts[0])) {
+		// warm the icon cache, one per idle loop
+		prefetch_icon(forecasts[prefetching++].icon);
 	}
 	timers.run();
+
+	if (provider.fetching()) {
+		uint8_t updated = provider.poll(conditions, forecasts, sizeof(forecasts)/sizeof(forecasts[0]));
+		if (!(updated & FETCH_PENDING))
+			fetched(fetching, updated);
+	} else if (queued) {
+		// the location first, as the weather's fetched for it
+		uint8_t what = (queued & FETCH_LOCATION)? FETCH_LOCATION: queued & -queued;
+		if (provider.combines() && what != FETCH_LOCATION)
+			what = queued & (FETCH_CONDITIONS | FETCH_FORECASTS);
+		queued &= ~what;
+		fetch(what);
+	}
+
+	if (busy && millis() - start > stats.max_loop_ms)
+		stats.max_loop_ms = millis() - start;
 }
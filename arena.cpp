@@ -0,0 +1,72 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "arena.h"
+
+Arena json_arena;
+
+static inline uint32_t round_up(size_t size) {
+	return (size + 7) & ~7;
+}
+
+void *Arena::allocate(size_t size) {
+
+	uint32_t n = round_up(size);
+	if (_top + sizeof(block) + n > sizeof(_mem))
+		return 0;
+
+	block *b = at(_top);
+	b->prev = _last;
+	b->size = n;
+	_last = _top;
+	_top += sizeof(block) + n;
+	if (_top > _peak)
+		_peak = _top;
+	return b + 1;
+}
+
+void Arena::deallocate(void *p) {
+
+	if (!p)
+		return;
+	block *b = (block *)p - 1;
+	b->size |= FREED;
+	pop();
+}
+
+// gives back freed blocks from the top
+void Arena::pop() {
+
+	while (_last != NONE && (at(_last)->size & FREED)) {
+		_top = _last;
+		_last = at(_last)->prev;
+	}
+}
+
+// strings and pools grow while being parsed, usually at the top
+void *Arena::reallocate(void *p, size_t size) {
+
+	if (!p)
+		return allocate(size);
+
+	block *b = (block *)p - 1;
+	uint32_t n = round_up(size);
+	if (offset(b) == _last) {
+		if (_last + sizeof(block) + n > sizeof(_mem))
+			return 0;
+		b->size = n;
+		_top = _last + sizeof(block) + n;
+		if (_top > _peak)
+			_peak = _top;
+		return p;
+	}
+	if (n <= b->size)
+		return p;
+
+	void *q = allocate(size);
+	if (!q)
+		return 0;
+	memcpy(q, p, b->size);
+	deallocate(p);
+	return q;
+}
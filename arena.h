@@ -0,0 +1,42 @@
+#pragma once
+
+// JSON documents are built here rather than on the heap, which they'd
+// otherwise fragment; slots are pointer-sized, so more is needed natively
+#ifndef JSON_ARENA
+#define JSON_ARENA	(1536 * sizeof(void *))
+#endif
+
+// a stack of blocks in a fixed buffer: a block is given back when it and
+// everything above it are freed, so documents destroyed in the reverse of
+// the order they were made leave it empty; one which doesn't fit fails with
+// NoMemory instead of going to the heap
+class Arena: public ArduinoJson::Allocator {
+public:
+	void *allocate(size_t size) override;
+	void deallocate(void *p) override;
+	void *reallocate(void *p, size_t size) override;
+
+	// forgets everything, only when no document is using it
+	void reset() { _top = 0; _last = NONE; }
+
+	size_t size() const { return sizeof(_mem); }
+	size_t used() const { return _top; }
+	size_t peak() const { return _peak; }
+
+private:
+	static const uint32_t NONE = 0xffffffff, FREED = 0x80000000;
+
+	struct block {
+		uint32_t prev;	// offset of the block below, or NONE
+		uint32_t size;	// rounded up, FREED when it has been
+	};
+
+	block *at(uint32_t offset) { return (block *)(_mem + offset); }
+	uint32_t offset(block *b) { return (uint8_t *)b - _mem; }
+	void pop();
+
+	alignas(8) uint8_t _mem[JSON_ARENA];
+	uint32_t _top = 0, _last = NONE, _peak = 0;
+};
+
+extern Arena json_arena;
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <string.h>
+#include <Arduino.h>
 #include <LittleFS.h>
 #include <time.h>
 #include <TFT_eSPI.h>
@@ -13,50 +14,82 @@
 #if !defined(ICON_W)
 #define ICON_W		50
 #endif
+#if !defined(ICON_H)
 #define ICON_H		ICON_W
+#endif
+
+// heap budget for icons, which are cached as they are in the pack, about
+// 2.5KB each for Open Meteo's and under 1KB for OWM's, and decoded as they're
+// drawn; -DICON_CACHE=0 disables caching
+#if !defined(ICON_CACHE)
+#define ICON_CACHE	16384
+#endif
+#define ICON_SLOTS	8
+
+// an icon is only cached if this much contiguous heap remains afterwards
+#define HEAP_RESERVE	12288
+
+// uncached icons are streamed to the display in blocks of this many rows
+#if !defined(ICON_ROWS)
+#define ICON_ROWS	8
+#endif
+
+// TFT_eSPI only has DMA on some processors (not the ESP8266), where the
+// next block is read while the last one is being sent
+#if defined(ESP32_DMA) || defined(RP2040_DMA) || defined(STM32_DMA)
+#define ICON_DMA
+static uint16_t blocks[2][ICON_W * ICON_ROWS];
+#else
+static uint16_t blocks[1][ICON_W * ICON_ROWS];
+#endif
 
 #define SMALL	1
 #define LARGE	2
 
+// where screens are drawn: the display itself or, when composing, a sprite
+static TFT_eSPI *gfx = &tft;
+
+#if defined(SPRITE)
+// when a screen is composed in strips, its icon is decoded once, into here,
+// and copied into each strip
+static struct {
+	uint16_t *pixels;
+	char name[16];
+	uint16_t x, y, w, h;
+} strip_icon;
+#endif
+
 // These read 16- and 32-bit types from the SD card file.
 // BMP data is stored little-endian, Arduino is little-endian too.
 // May need to reverse subscript order if porting elsewhere.
 static uint16_t read16(File &f) {
-	uint16_t result;
-	size_t n = f.read((uint8_t *)&result, sizeof(result));
+	uint16_t result = 0;
+	f.read((uint8_t *)&result, sizeof(result));
 	return result;
 }
 
 static uint32_t read32(File &f) {
-	uint32_t result;
-	size_t n = f.read((uint8_t *)&result, sizeof(result));
+	uint32_t result = 0;
+	f.read((uint8_t *)&result, sizeof(result));
 	return result;
 }
 
-// from Adafruit's spitftbitmap ST7735 example
-// updated with Bodmer's example in BMP_functions.cpp
-static int display_bmp(const char *filename, uint16_t x, uint16_t y) {
-
-	if ((x >= tft.width()) || (y >= tft.height())) return -1;
+enum icon_format { BMP, PACKED };
 
-	uint32_t startTime = millis();
+struct icon {
+	char name[16];
+	uint32_t used;
+	uint16_t size;
+	uint8_t *packed;
+};
 
-	char fbuf[32];
-	strcpy(fbuf, "/");
-	strcat(fbuf, filename);
-	strcat(fbuf, ".bmp");
-	File f = LittleFS.open(fbuf, "r");
-	if (!f) {
-		ERR(print(F("file.open!")));
-		ERR(print(' '));
-		ERR(println(filename));
-		return -1;
-	}
+// from Adafruit's spitftbitmap ST7735 example
+// updated with Bodmer's example in BMP_functions.cpp
+static int draw_bmp(File &f, uint16_t x, uint16_t y) {
 
 	// Parse BMP header
 	if (read16(f) != 0x4D42) {
 		ERR(println(F("Unknown BMP signature")));
-		f.close();
 		return -1;
 	}
 
@@ -78,7 +111,6 @@ static int display_bmp(const char *filename, uint16_t x, uint16_t y) {
 	uint16_t h = read32(f);
 	if (read16(f) != 1) {
 		ERR(println(F("# planes -- must be '1'")));
-		f.close();
 		return -1;
 	}
 	uint16_t bmpDepth = read16(f); // bits per pixel
@@ -87,7 +119,6 @@ static int display_bmp(const char *filename, uint16_t x, uint16_t y) {
 	if ((bmpDepth != 24) || (read32(f) != 0)) {
 		// 0 = uncompressed
 		ERR(println(F("BMP format not recognized.")));
-		f.close();
 		return -1; 
 	}
 	
@@ -97,7 +128,7 @@ static int display_bmp(const char *filename, uint16_t x, uint16_t y) {
 	DBG(println(h));
 	
 	uint32_t rowSize = (w * 3 + 3) & ~3;
-	tft.setSwapBytes(true);
+	gfx->setSwapBytes(true);
 	y += h-1;
 	
 	uint16_t padding = (4 - ((w * 3) & 3)) & 3;
@@ -118,37 +149,447 @@ static int display_bmp(const char *filename, uint16_t x, uint16_t y) {
 			uint8_t r = *bptr++;
 			*tptr++ = tft.color565(r, g, b);
 		}
-		tft.pushImage(x, y--, w, 1, (uint16_t*)lineBuffer);
+		gfx->pushImage(x, y, w, 1, (uint16_t*)lineBuffer);
+		y--;
 		pos += rowSize;
 	}
-	f.close();
+	return 0;
+}
+
+// streams an icon to the display in blocks through a single window,
+// fill() supplying each block's pixels
+static int push_blocks(uint16_t x, uint16_t y, uint16_t w, uint16_t h, std::function<bool(uint16_t *, size_t)> fill) {
+
+	if (w > ICON_W || h > ICON_H) {
+		ERR(println(F("Image too big")));
+		return -1;
+	}
+
+	if (gfx != &tft) {
+		// composing off-screen
+		gfx->setSwapBytes(true);
+#if defined(SPRITE)
+		if (strip_icon.pixels) {
+			if (!fill(strip_icon.pixels, w * h)) {
+				ERR(println(F("Short read")));
+				return -1;
+			}
+			strip_icon.w = w;
+			strip_icon.h = h;
+			gfx->pushImage(x, y, w, h, strip_icon.pixels);
+			return 0;
+		}
+#endif
+		for (uint16_t row = 0, n; row < h; row += n) {
+			n = h - row < ICON_ROWS? h - row: ICON_ROWS;
+			if (!fill(blocks[0], w * n)) {
+				ERR(println(F("Short read")));
+				return -1;
+			}
+			gfx->pushImage(x, y + row, w, n, blocks[0]);
+		}
+		return 0;
+	}
+
+#if defined(ICON_DMA)
+	if (!tft.DMA_Enabled)
+		tft.initDMA();
+#endif
+
+	tft.setSwapBytes(true);
+	tft.startWrite();
+	tft.setAddrWindow(x, y, w, h);
+
+	int ret = 0;
+	for (uint16_t row = 0, b = 0, n; row < h; row += n) {
+		n = h - row < ICON_ROWS? h - row: ICON_ROWS;
+		if (!fill(blocks[b], w * n)) {
+			ERR(println(F("Short read")));
+			ret = -1;
+			break;
+		}
+#if defined(ICON_DMA)
+		// waits for the previous block, which used the other buffer
+		tft.pushPixelsDMA(blocks[b], w * n);
+		b ^= 1;
+#else
+		tft.pushPixels(blocks[b], w * n);
+#endif
+	}
+
+#if defined(ICON_DMA)
+	tft.dmaWait();
+#endif
+	tft.endWrite();
+	return ret;
+}
+
+// icons in the pack built by tools/iconpack.py: a sorted index of names
+// and offsets, then each icon's palette and run-length encoded pixels
+#define ICON_PACK	"/icons.pak"
+#define PACK_NAME	12
+
+// an icon is read from the pack, through buf, or from the cache
+static struct {
+	File *f;
+	const uint8_t *p, *end;
+	uint8_t buf[64];
+	uint16_t colours, pixel, count;
+	bool repeat, eof;
+} rle;
+
+static uint16_t palette[256];
+
+static void rle_open(File *f, const uint8_t *p, size_t n) {
+	rle.f = f;
+	rle.p = p;
+	rle.end = p + n;
+	rle.count = 0;
+	rle.eof = false;
+}
+
+static uint8_t rle_byte() {
+	if (rle.p == rle.end) {
+		size_t n = rle.f? rle.f->read(rle.buf, sizeof(rle.buf)): 0;
+		if (!n) {
+			rle.eof = true;
+			return 0;
+		}
+		rle.p = rle.buf;
+		rle.end = rle.buf + n;
+	}
+	return *rle.p++;
+}
+
+static uint16_t rle_word() {
+	uint16_t lo = rle_byte();
+	return lo | (rle_byte() << 8);
+}
+
+static uint16_t rle_pixel() {
+	if (rle.colours)
+		return palette[rle_byte()];
+	return rle_word();
+}
+
+// expands runs straight into the output buffer
+static bool rle_expand(uint16_t *out, size_t n) {
+	while (n > 0) {
+		if (!rle.count) {
+			uint8_t t = rle_byte();
+			rle.repeat = t & 0x80;
+			rle.count = (t & 0x7f) + 1;
+			if (rle.repeat)
+				rle.pixel = rle_pixel();
+		}
+		uint16_t k = rle.count < n? rle.count: n;
+		rle.count -= k;
+		n -= k;
+		if (rle.repeat)
+			while (k--)
+				*out++ = rle.pixel;
+		else
+			while (k--)
+				*out++ = rle_pixel();
+	}
+	return !rle.eof;
+}
+
+// positions the file at the named icon, whose size is found from where the next starts
+static bool find_packed(File &f, const char *name, uint32_t &size) {
+
+	if (read16(f) != 0x5049) {
+		ERR(println(F("Unknown icon pack signature")));
+		return false;
+	}
+
+	uint16_t lo = 0, hi = read16(f), count = hi;
+	while (lo < hi) {
+		uint16_t mid = (lo + hi) / 2;
+		char entry[PACK_NAME];
+		f.seek(4 + mid * (PACK_NAME + sizeof(uint32_t)));
+		f.read((uint8_t *)entry, sizeof(entry));
+		int c = strncmp(name, entry, sizeof(entry));
+		if (!c) {
+			uint32_t offset = read32(f), next = f.size();
+			if (mid + 1 < count) {
+				f.seek(4 + (mid + 1) * (PACK_NAME + sizeof(uint32_t)) + PACK_NAME);
+				next = read32(f);
+			}
+			size = next - offset;
+			return f.seek(offset);
+		}
+		if (c < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return false;
+}
+
+// from wherever rle_open() said
+static int draw_packed(uint16_t x, uint16_t y) {
+
+	uint16_t w = rle_word();
+	uint16_t h = rle_word();
+	uint16_t colours = rle_word();
+	if (colours > 256) {
+		ERR(println(F("Bad icon palette")));
+		return -1;
+	}
+	for (uint16_t i = 0; i < colours; i++)
+		palette[i] = rle_word();
+	rle.colours = colours;
+	if (rle.eof) {
+		ERR(println(F("Short read")));
+		return -1;
+	}
+
+	return push_blocks(x, y, w, h, rle_expand);
+}
+
+// looks in the icon pack staged by the Makefile first, falling back to the
+// BMP for filesystems uploaded directly from data/
+static File open_icon(const char *filename, enum icon_format &fmt, uint32_t &size) {
+
+	File f = LittleFS.open(ICON_PACK, "r");
+	if (f) {
+		if (find_packed(f, filename, size)) {
+			fmt = PACKED;
+			return f;
+		}
+		f.close();
+	}
+
+	char fbuf[32];
+	snprintf(fbuf, sizeof(fbuf), "/%s.bmp", filename);
+	f = LittleFS.open(fbuf, "r");
+	fmt = BMP;
+	if (!f) {
+		ERR(print(F("file.open!")));
+		ERR(print(' '));
+		ERR(println(filename));
+	}
+	return f;
+}
+
+static int decode_icon(File &f, enum icon_format fmt, uint16_t x, uint16_t y) {
+	switch (fmt) {
+	case PACKED:
+		rle_open(&f, 0, 0);
+		return draw_packed(x, y);
+	default:
+		return draw_bmp(f, x, y);
+	}
+}
+
+#if ICON_CACHE > 0
+static struct icon icons[ICON_SLOTS];
+static uint32_t icon_clock, icon_bytes;
+
+static struct icon *cached_icon(const char *name) {
+	for (unsigned i = 0; i < ICON_SLOTS; i++) {
+		struct icon &ic = icons[i];
+		if (ic.packed && !strcmp(ic.name, name)) {
+			ic.used = ++icon_clock;
+			return &ic;
+		}
+	}
+	return 0;
+}
+
+static void evict(struct icon &ic) {
+	free(ic.packed);
+	ic.packed = 0;
+	icon_bytes -= ic.size;
+	stats.icon_evictions++;
+}
+
+// an empty slot with room for size bytes in the budget, and heap to spare,
+// evicting the least-recently used icons to make it
+static struct icon *icon_slot(uint16_t size) {
+	for (;;) {
+		struct icon *empty = 0, *lru = 0;
+		for (unsigned i = 0; i < ICON_SLOTS; i++) {
+			struct icon &ic = icons[i];
+			if (!ic.packed)
+				empty = &ic;
+			else if (!lru || ic.used < lru->used)
+				lru = &ic;
+		}
+		if (empty && icon_bytes + size <= ICON_CACHE
+				&& ESP.getMaxFreeBlockSize() >= (uint32_t)size + HEAP_RESERVE)
+			return empty;
+		if (!lru)
+			return 0;
+		evict(*lru);
+	}
+}
+
+// only icons from the pack are cached, and only those which will draw
+static struct icon *load_icon(File &f, enum icon_format fmt, uint32_t size, const char *name) {
+	if (fmt != PACKED || size > ICON_CACHE)
+		return 0;
+
+	size_t start = f.position();
+	uint16_t w = read16(f), h = read16(f);
+	f.seek(start);
+	if (w > ICON_W || h > ICON_H)
+		return 0;
+
+	struct icon *ic = icon_slot(size);
+	if (!ic)
+		return 0;
+	ic->packed = (uint8_t *)malloc(size);
+	if (!ic->packed)
+		return 0;
+	if (f.read(ic->packed, size) != size) {
+		free(ic->packed);
+		ic->packed = 0;
+		f.seek(start);
+		return 0;
+	}
+	strlcpy(ic->name, name, sizeof(ic->name));
+	ic->size = size;
+	ic->used = ++icon_clock;
+	icon_bytes += size;
+	return ic;
+}
+#else
+static struct icon *cached_icon(const char *name) { return 0; }
+
+static struct icon *load_icon(File &f, enum icon_format fmt, uint32_t size, const char *name) { return 0; }
+#endif
+
+void prefetch_icon(const char *name) {
+	if (cached_icon(name))
+		return;
+
+	enum icon_format fmt;
+	uint32_t size;
+	File f = open_icon(name, fmt, size);
+	if (f) {
+		load_icon(f, fmt, size, name);
+		f.close();
+	}
+}
+
+static int display_bmp(const char *filename, uint16_t x, uint16_t y) {
+
+	if ((x >= tft.width()) || (y >= tft.height())) return -1;
+
+#if defined(SPRITE)
+	if (strip_icon.pixels) {
+		if (strip_icon.w && strip_icon.x == x && strip_icon.y == y && !strcmp(strip_icon.name, filename)) {
+			gfx->setSwapBytes(true);
+			gfx->pushImage(x, y, strip_icon.w, strip_icon.h, strip_icon.pixels);
+			return 0;
+		}
+		strip_icon.w = 0;
+		strlcpy(strip_icon.name, filename, sizeof(strip_icon.name));
+		strip_icon.x = x;
+		strip_icon.y = y;
+	}
+#endif
+
+	uint32_t startTime = millis();
+	int ret = -1;
+
+	struct icon *ic = cached_icon(filename);
+	if (ic)
+		stats.icon_hits++;
+	else {
+		stats.icon_misses++;
+
+		enum icon_format fmt;
+		uint32_t size;
+		File f = open_icon(filename, fmt, size);
+		if (!f)
+			return -1;
+
+		size_t start = f.position();
+		ic = load_icon(f, fmt, size, filename);
+		if (!ic) {
+			// not cached, draw it straight from the file
+			f.seek(start);
+			ret = decode_icon(f, fmt, x, y);
+		}
+		f.close();
+	}
+	if (ic) {
+		rle_open(0, ic->packed, ic->size);
+		ret = draw_packed(x, y);
+	}
+
 	DBG(print(F("Loaded in ")));
 	DBG(print(millis() - startTime));
-	DBG(println(F(" ms")));
-	return 0;
+	DBG(print(F(" ms, icon hit rate ")));
+	DBG(print(stats.icon_hit_rate()));
+	DBG(println('%'));
+	return ret;
+}
+
+struct box {
+	int16_t x, y, w, h;
+};
+
+// while a field of the weather screen is drawn, the box covering it
+static struct box *marking;
+
+static void mark(int16_t x, int16_t y, int16_t w, int16_t h) {
+	if (!marking)
+		return;
+	struct box &b = *marking;
+	if (!b.w) {
+		b = { x, y, w, h };
+		return;
+	}
+	int16_t x1 = max(b.x + b.w, x + w), y1 = max(b.y + b.h, y + h);
+	b.x = min(b.x, x);
+	b.y = min(b.y, y);
+	b.w = x1 - b.x;
+	b.h = y1 - b.y;
+}
+
+// marks a line of text from (x, y) to the cursor
+static void mark_text(int16_t x, int16_t y, int16_t h) {
+	mark(x, y, gfx->getCursorX() - x, h);
+}
+
+static bool overlaps(struct box &a, struct box &b) {
+	return a.w && b.w && a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+static void clear(uint16_t colour) {
+	gfx->fillRect(0, 0, tft.width(), tft.height(), colour);
 }
 
 static int centre_text(const char *s) {
-	return (tft.width() - tft.textWidth(s)) / 2;
+	return (tft.width() - gfx->textWidth(s)) / 2;
 }
 
 static int width(char c) {
 	char buf[2];
 	buf[0] = c;
 	buf[1] = 0;
-	return tft.textWidth(buf);
+	return gfx->textWidth(buf);
 }
 
 static void display_time(time_t &local, bool metric) {
-	tft.setTextSize(SMALL);
+	gfx->setTextSize(SMALL);
 	char buf[32];
 	strftime(buf, sizeof(buf), metric? "%H:%M": "%I:%M%p", localtime(&local));
-	tft.setCursor(centre_text(buf), tft.height() - 2*tft.fontHeight());
-	tft.print(buf);
+	int16_t x = centre_text(buf), y = tft.height() - 2*gfx->fontHeight();
+	gfx->setCursor(x, y);
+	gfx->print(buf);
+	mark_text(x, y, gfx->fontHeight());
 
 	strftime(buf, sizeof(buf), "%a %e", localtime(&local));
-	tft.setCursor(centre_text(buf), tft.height() - tft.fontHeight());
-	tft.print(buf);
+	x = centre_text(buf);
+	y = tft.height() - gfx->fontHeight();
+	gfx->setCursor(x, y);
+	gfx->print(buf);
+	mark_text(x, y, gfx->fontHeight());
 }
 
 static void display_wind(int wind_degrees, int wind_speed) {
@@ -167,8 +608,11 @@ static void display_wind(int wind_degrees, int wind_speed) {
 	}
 	// wind dir rotates clockwise so compensate
 	int ex = cx-rad*cos, ey = cy-rad*sin;
-	tft.fillCircle(ex, ey, 3, TFT_BLACK);
-	tft.drawLine(ex, ey, ex+wind_speed*(cx-ex)/ICON_W, ey+wind_speed*(cy-ey)/ICON_H, TFT_BLACK);
+	int lx = ex+wind_speed*(cx-ex)/ICON_W, ly = ey+wind_speed*(cy-ey)/ICON_H;
+	gfx->fillCircle(ex, ey, 3, TFT_BLACK);
+	gfx->drawLine(ex, ey, lx, ly, TFT_BLACK);
+	mark(ex - 3, ey - 3, 7, 7);
+	mark(min(ex, lx), min(ey, ly), abs(lx - ex) + 1, abs(ly - ey) + 1);
 }
 
 static const __FlashStringHelper *wind_dir(int d) {
@@ -192,159 +636,313 @@ static const __FlashStringHelper *wind_dir(int d) {
 }
 
 static void display_wind_speed(int speed, int deg, bool metric) {
-	tft.setTextSize(LARGE);
-	int h = tft.fontHeight();
-	tft.setCursor(1, 1);
-	tft.print(speed);
-	tft.setTextSize(SMALL);
-	tft.print(metric? F("kph"): F("mph"));
-	tft.setCursor(1, h+1);
-	tft.print(wind_dir(deg));
+	gfx->setTextSize(LARGE);
+	int h = gfx->fontHeight();
+	gfx->setCursor(1, 1);
+	gfx->print(speed);
+	gfx->setTextSize(SMALL);
+	gfx->print(metric? F("kph"): F("mph"));
+	mark_text(1, 1, h);
+	gfx->setCursor(1, h+1);
+	gfx->print(wind_dir(deg));
+	mark_text(1, h+1, gfx->fontHeight());
 }
 
 static void display_temperature(int temp, int temp_min, bool metric) {
-	tft.setTextSize(LARGE);
-	int h = tft.fontHeight();
-	tft.setCursor(1, tft.height() - h);
-	tft.print(temp);
-	tft.setTextSize(SMALL);
-	tft.print(metric? 'C': 'F');
+	gfx->setTextSize(LARGE);
+	int h = gfx->fontHeight();
+	gfx->setCursor(1, tft.height() - h);
+	gfx->print(temp);
+	gfx->setTextSize(SMALL);
+	gfx->print(metric? 'C': 'F');
+	mark_text(1, tft.height() - h, h);
 	if (temp > temp_min) {
-		tft.setCursor(1, tft.height() - h - tft.fontHeight());
-		tft.print(temp_min);
+		gfx->setCursor(1, tft.height() - h - gfx->fontHeight());
+		gfx->print(temp_min);
+		mark_text(1, tft.height() - h - gfx->fontHeight(), gfx->fontHeight());
 	}
 }
 
 static void display_humidity(int humidity) {
-	tft.setTextSize(LARGE);
-	int h = tft.fontHeight();
-	tft.setTextSize(SMALL);
+	gfx->setTextSize(LARGE);
+	int h = gfx->fontHeight();
+	gfx->setTextSize(SMALL);
 	int w = width('%');
-	tft.setCursor(tft.width() - w - SMALL, tft.height() - h);
-	tft.print('%');
-	tft.setTextSize(LARGE);
+	gfx->setCursor(tft.width() - w - SMALL, tft.height() - h);
+	gfx->print('%');
+	gfx->setTextSize(LARGE);
 	char hum[8];
 	snprintf(hum, sizeof(hum), "%d", humidity);
-	tft.setCursor(tft.width() - tft.textWidth(hum) - w - SMALL, tft.height() - h);
-	tft.print(hum);
+	int16_t x = tft.width() - gfx->textWidth(hum) - w - SMALL;
+	gfx->setCursor(x, tft.height() - h);
+	gfx->print(hum);
+	mark(x, tft.height() - h, tft.width() - x, h);
 }
 
-void display_weather(struct Conditions &c) {
-	tft.fillScreen(TFT_WHITE);
-	tft.setTextColor(TFT_BLACK);
+#if defined(DRAW_MOON)
+#define MOON_R		(ICON_W * 3 / 8)
+#define MOON_LIT	0xF79E
+#define MOON_DARK	0x2124
+
+static uint16_t isqrt(uint32_t n) {
+	uint32_t r = 0, b = 1ul << 30;
+	while (b > n)
+		b >>= 2;
+	while (b) {
+		if (n >= r + b) {
+			n -= r + b;
+			r = (r >> 1) + b;
+		} else
+			r >>= 1;
+		b >>= 2;
+	}
+	return r;
+}
 
-	display_wind_speed(c.wind, c.wind_degrees, cfg.metric? F("kph"): F("mph"));
-	display_temperature(c.temp, c.feelslike, cfg.metric);
-	display_humidity(c.humidity);
+// draws the moon's disc, lit according to its phase, as horizontal spans;
+// the only floating-point is one cosine per paint
+static void draw_moon(time_t epoch, int cx, int cy) {
+	const long new_moon = 937008000;	// Aug 11, 1999, as Provider::moon_age()
+	const uint32_t lunation = 2551443;	// 29.530588853 days, in seconds
+
+	uint32_t t = (uint32_t)((long)epoch - new_moon) % lunation;
+	bool waxing = t < lunation / 2;
+	int32_t k = (int32_t)(32768 * cos(2 * PI * t / lunation));
+
+	for (int dy = -MOON_R; dy <= MOON_R; dy++) {
+		int hw = isqrt(MOON_R * MOON_R - dy * dy), w = 2 * hw + 1;
+		int lit = (w * (32768 - k)) >> 16;
+		int x = cx - hw, y = cy + dy;
+		if (waxing) {
+			gfx->drawFastHLine(x, y, w - lit, MOON_DARK);
+			gfx->drawFastHLine(x + w - lit, y, lit, MOON_LIT);
+		} else {
+			gfx->drawFastHLine(x, y, lit, MOON_LIT);
+			gfx->drawFastHLine(x + lit, y, w - lit, MOON_DARK);
+		}
+	}
+}
+#endif
 
-	tft.setTextSize(SMALL);
-	const char *unit = cfg.metric? "mb": "in";
-	int uw = tft.textWidth(unit);
-	tft.setTextSize(LARGE);
+static void display_pressure(int pressure, int pressure_trend, bool metric) {
+	gfx->setTextSize(SMALL);
+	const char *unit = metric? "mb": "in";
+	int uw = gfx->textWidth(unit);
+	gfx->setTextSize(LARGE);
+	int h = gfx->fontHeight();
 	char pres[8];
-	snprintf(pres, sizeof(pres), "%d", c.pressure);
-	tft.setCursor(tft.width() - tft.textWidth(pres) - uw - SMALL, 1);
-	tft.print(c.pressure);
-	tft.setTextSize(SMALL);
-	tft.print(unit);
+	snprintf(pres, sizeof(pres), "%d", pressure);
+	int16_t x = tft.width() - gfx->textWidth(pres) - uw - SMALL;
+	gfx->setCursor(x, 1);
+	gfx->print(pressure);
+	gfx->setTextSize(SMALL);
+	gfx->print(unit);
+	mark_text(x, 1, h);
 	const char *trend = 0;
-	if (c.pressure_trend == 1) {
+	if (pressure_trend == 1) {
 		trend = "rising";
-	} else if (c.pressure_trend == -1) {
+	} else if (pressure_trend == -1) {
 		trend = "falling";
 	}
 	if (trend) {
-		tft.setCursor(tft.width() - tft.textWidth(trend) - SMALL, tft.fontHeight()+1);
-		tft.print(trend);
+		x = tft.width() - gfx->textWidth(trend) - SMALL;
+		gfx->setCursor(x, gfx->fontHeight()+1);
+		gfx->print(trend);
+		mark_text(x, gfx->fontHeight()+1, gfx->fontHeight());
 	}
+}
+
+static void display_centred(const char *s, int16_t y) {
+	gfx->setTextSize(SMALL);
+	int16_t x = centre_text(s);
+	gfx->setCursor(x, y);
+	gfx->print(s);
+	mark_text(x, y, gfx->fontHeight());
+}
+
+// the weather screen's fields, in the order they're drawn, and what
+// was last drawn so that only those which change need be redrawn
+enum field { WIND_SPEED, TEMPERATURE, HUMIDITY, PRESSURE, CITY, WEATHER, ICON, TIME, WIND, FIELDS };
 
-	unsigned by = (tft.height() - ICON_H)/2, cy = by - tft.fontHeight(), wy = by + ICON_H;
-	tft.setCursor(centre_text(c.city), cy);
-	tft.print(c.city);
-	tft.setCursor(centre_text(c.weather), wy);
-	tft.print(c.weather);
-	display_bmp(c.icon, (tft.width() - ICON_W)/2, by);
+static struct box boxes[FIELDS];
+static struct Conditions shown;
+static bool shown_metric;
 
-	display_time(c.epoch, cfg.metric);
-	if (c.wind > 0)
-		display_wind(c.wind_degrees, c.wind);
+// which screen is showing, and the time on it
+static enum { OTHER, WEATHER_SCREEN, ASTRONOMY_SCREEN } showing;
+static time_t shown_time;
+static struct box time_box;
+
+// the local time, once set by SNTP, otherwise that of the observation
+static time_t local_time(time_t observed) {
+	time_t now = time(0);
+	if (now < 1600000000)
+		return observed;
+	return tz->toLocal(now);
 }
 
-void display_astronomy(struct Conditions &c) {
-	tft.fillScreen(TFT_BLACK);
-	tft.setTextColor(TFT_WHITE);
+static void draw_field(int f, struct Conditions &c) {
+	unsigned by = (tft.height() - ICON_H)/2;
+
+	marking = &boxes[f];
+	*marking = {};
+	switch (f) {
+	case WIND_SPEED:
+		display_wind_speed(c.wind, c.wind_degrees, cfg.metric);
+		break;
+	case TEMPERATURE:
+		display_temperature(c.temp, c.feelslike, cfg.metric);
+		break;
+	case HUMIDITY:
+		display_humidity(c.humidity);
+		break;
+	case PRESSURE:
+		display_pressure(c.pressure, c.pressure_trend, cfg.metric);
+		break;
+	case CITY:
+		gfx->setTextSize(SMALL);
+		display_centred(c.city, by - gfx->fontHeight());
+		break;
+	case WEATHER:
+		display_centred(c.weather, by + ICON_H);
+		break;
+	case ICON:
+		display_bmp(c.icon, (tft.width() - ICON_W)/2, by);
+		mark((tft.width() - ICON_W)/2, by, ICON_W, ICON_H);
+		break;
+	case TIME:
+		shown_time = local_time(c.epoch);
+		if (c.stale)
+			gfx->setTextColor(TFT_DARKGREY);
+		display_time(shown_time, cfg.metric);
+		gfx->setTextColor(TFT_BLACK);
+		break;
+	case WIND:
+		if (c.wind > 0)
+			display_wind(c.wind_degrees, c.wind);
+		break;
+	}
+	marking = 0;
+}
+
+static bool changed(int f, struct Conditions &a, struct Conditions &b) {
+	switch (f) {
+	case WIND_SPEED:
+	case WIND:
+		return a.wind != b.wind || a.wind_degrees != b.wind_degrees;
+	case TEMPERATURE:
+		return a.temp != b.temp || a.feelslike != b.feelslike;
+	case HUMIDITY:
+		return a.humidity != b.humidity;
+	case PRESSURE:
+		return a.pressure != b.pressure || a.pressure_trend != b.pressure_trend;
+	case CITY:
+		return strcmp(a.city, b.city);
+	case WEATHER:
+		return strcmp(a.weather, b.weather);
+	case ICON:
+		return strcmp(a.icon, b.icon);
+	case TIME:
+		return local_time(b.epoch) / 60 != shown_time / 60 || a.stale != b.stale;
+	}
+	return true;
+}
+
+static void paint_weather(struct Conditions &c) {
+	clear(TFT_WHITE);
+	gfx->setTextColor(TFT_BLACK);
+
+	for (int f = 0; f < FIELDS; f++)
+		draw_field(f, c);
+}
 
-	tft.setTextSize(LARGE);
-	int h = tft.fontHeight();
-	tft.setCursor(1, 1);
-	tft.print(F("sun"));
+static void paint_astronomy(struct Conditions &c) {
+	clear(TFT_BLACK);
+	gfx->setTextColor(TFT_WHITE);
+
+	gfx->setTextSize(LARGE);
+	int h = gfx->fontHeight();
+	gfx->setCursor(1, 1);
+	gfx->print(F("sun"));
 	const char *moon = "moon";
-	tft.setCursor(tft.width() - tft.textWidth(moon) - LARGE, 1);
-	tft.print(moon);
-	tft.setTextSize(SMALL);
-	tft.setCursor(c.sunrise_hour < 10? 1+width(c.sunrise_hour): 1, 1+h);
-	tft.print(c.sunrise_hour);
-	tft.print(':');
-	if (c.sunrise_minute < 10) tft.print('0');
-	tft.print(c.sunrise_minute);
-	tft.setCursor(1, 1+h+tft.fontHeight());
-	tft.print(c.sunset_hour);
-	tft.print(':');
-	if (c.sunset_minute < 10) tft.print('0');
-	tft.print(c.sunset_minute);
+	gfx->setCursor(tft.width() - gfx->textWidth(moon) - LARGE, 1);
+	gfx->print(moon);
+	gfx->setTextSize(SMALL);
+	gfx->setCursor(c.sunrise_hour < 10? 1+width(c.sunrise_hour): 1, 1+h);
+	gfx->print(c.sunrise_hour);
+	gfx->print(':');
+	if (c.sunrise_minute < 10) gfx->print('0');
+	gfx->print(c.sunrise_minute);
+	gfx->setCursor(1, 1+h+gfx->fontHeight());
+	gfx->print(c.sunset_hour);
+	gfx->print(':');
+	if (c.sunset_minute < 10) gfx->print('0');
+	gfx->print(c.sunset_minute);
 
 	const char *rise = "rise";
-	tft.setCursor(centre_text(rise), 1+h);
-	tft.print(rise);
+	gfx->setCursor(centre_text(rise), 1+h);
+	gfx->print(rise);
 	const char *set = "set";
-	tft.setCursor(centre_text(set), 1+h+tft.fontHeight());
-	tft.print(set);
+	gfx->setCursor(centre_text(set), 1+h+gfx->fontHeight());
+	gfx->print(set);
 
 	int rl = strlen(c.moonrise_hour);
 	if (rl > 0) {
 		char buf[16];
 		snprintf(buf, sizeof(buf), "%s:%s", c.moonrise_hour, c.moonrise_minute);
-		tft.setCursor(tft.width() - tft.textWidth(buf) - SMALL, 1+h);
-		tft.print(buf);
+		gfx->setCursor(tft.width() - gfx->textWidth(buf) - SMALL, 1+h);
+		gfx->print(buf);
 		snprintf(buf, sizeof(buf), "%s:%s", c.moonset_hour, c.moonset_minute);
-		tft.setCursor(tft.width() - tft.textWidth(buf) - SMALL, 1+h+tft.fontHeight());
-		tft.print(buf);
+		gfx->setCursor(tft.width() - gfx->textWidth(buf) - SMALL, 1+h+gfx->fontHeight());
+		gfx->print(buf);
 	}
 
+	unsigned by = (tft.height() - ICON_H)/2, ay = by + ICON_H;
+#if defined(DRAW_MOON)
+	draw_moon(c.epoch, tft.width()/2, by + ICON_H/2);
+#else
 	char buf[32];
 	snprintf(buf, sizeof(buf), "moon%d", c.age_of_moon);
-	unsigned by = (tft.height() - ICON_H)/2, ay = by + ICON_H;
 	display_bmp(buf, (tft.width() - ICON_W)/2, by);
+#endif
 
-	tft.setCursor(centre_text(c.moon_phase), ay);
-	tft.print(c.moon_phase);
+	gfx->setCursor(centre_text(c.moon_phase), ay);
+	gfx->print(c.moon_phase);
 
-	display_time(c.epoch, cfg.metric);
+	marking = &time_box;
+	*marking = {};
+	shown_time = local_time(c.epoch);
+	display_time(shown_time, cfg.metric);
+	marking = 0;
 }
 
-void display_forecast(struct Forecast &f) {
-	tft.fillScreen(TFT_WHITE);
-	tft.setTextColor(TFT_BLACK);
+static void paint_forecast(struct Forecast &f) {
+	clear(TFT_WHITE);
+	gfx->setTextColor(TFT_BLACK);
 
 	display_wind_speed(f.ave_wind, f.wind_degrees, cfg.metric);
 	display_temperature(f.temp_high, f.temp_low, cfg.metric);
 	if (f.humidity >= 0)
 		display_humidity(f.humidity);
 
-	tft.setTextSize(LARGE);
-	char day[4];
-	strftime(day, sizeof(day), "%a", localtime(&f.epoch));
-	tft.setCursor(tft.width() - tft.textWidth(day) - LARGE, 1);
-	tft.print(day);
+	// its day isn't known until it's fetched again
+	if (f.epoch) {
+		gfx->setTextSize(LARGE);
+		char day[4];
+		strftime(day, sizeof(day), "%a", localtime(&f.epoch));
+		gfx->setCursor(tft.width() - gfx->textWidth(day) - LARGE, 1);
+		gfx->print(day);
+	}
 
-	tft.setTextSize(SMALL);
+	gfx->setTextSize(SMALL);
 	unsigned by = (tft.height() - ICON_H)/2, wy = by + ICON_H;
 	display_bmp(f.icon, (tft.width() - ICON_W)/2, by);
 
-	tft.setCursor(centre_text(f.conditions), wy);
-	tft.print(f.conditions);
+	gfx->setCursor(centre_text(f.conditions), wy);
+	gfx->print(f.conditions);
 
-	display_time(f.epoch, cfg.metric);
+	if (f.epoch)
+		display_time(f.epoch, cfg.metric);
 	display_wind(f.wind_degrees, f.ave_wind);
 }
 
@@ -362,39 +960,174 @@ static char *hms(uint32_t t) {
 	return buf;
 }
 
-void display_about(struct Statistics &s) {
-	tft.fillScreen(TFT_BLACK);
-	tft.setTextColor(TFT_WHITE);
-	tft.setCursor(1, 1);
+static void paint_about(struct Statistics &s) {
+	clear(TFT_BLACK);
+	gfx->setTextColor(TFT_WHITE);
+	gfx->setCursor(1, 1);
 
 	uint32_t now = millis();
 #if defined(WWG_VERSION)
-	tft.print(F("Version: "));
-	tft.println(F(WWG_VERSION));
+	gfx->print(F("Version: "));
+	gfx->println(F(WWG_VERSION));
+#endif
+	gfx->print(F("Uptime: "));
+	gfx->println(hms(now / 1000));
+	gfx->print(F("First frame: "));
+	gfx->print(s.first_frame_ms);
+	gfx->println(F("ms"));
+	gfx->println();
+	gfx->print(F("Updates: "));
+	gfx->println(s.num_updates);
+	gfx->print(F("Conditions: "));
+	gfx->println(hms((now - s.last_fetch_conditions) / 1000));
+	gfx->print(F("Forecasts:  "));
+	gfx->println(hms((now - s.last_fetch_forecasts) / 1000));
+	gfx->print(F("Age: "));
+	gfx->println(s.last_age? hms(s.last_age): "");
+	gfx->print(F("Min: "));
+	gfx->println(s.min_age? hms(s.min_age): "");
+	gfx->print(F("Max: "));
+	gfx->println(s.max_age? hms(s.max_age): "");
+	gfx->print(F("Ave: "));
+	gfx->println(s.num_updates > 1? hms(s.total / (s.num_updates-1)): "");
+	gfx->println();
+	gfx->println(F("Failures"));
+	gfx->print("Connect: ");
+	gfx->println(s.connect_failures);
+	gfx->print("Parse:   ");
+	gfx->println(s.parse_failures);
+	gfx->print("Memory:  ");
+	gfx->println(s.mem_failures);
+}
+
+#if defined(SPRITE)
+// screens are composed off-screen and sent in strips, each in one burst;
+// a strip and an icon's pixels fit in the heap left after caching icons
+#if !defined(SPRITE_BYTES)
+#define SPRITE_BYTES	(HEAP_RESERVE - ICON_W * ICON_H * 2)
 #endif
-	tft.print(F("Uptime: "));
-	tft.println(hms(now / 1000));
-	tft.println();
-	tft.print(F("Updates: "));
-	tft.println(s.num_updates);
-	tft.print(F("Conditions: "));
-	tft.println(hms((now - s.last_fetch_conditions) / 1000));
-	tft.print(F("Forecasts:  "));
-	tft.println(hms((now - s.last_fetch_forecasts) / 1000));
-	tft.print(F("Age: "));
-	tft.println(s.last_age? hms(s.last_age): "");
-	tft.print(F("Min: "));
-	tft.println(s.min_age? hms(s.min_age): "");
-	tft.print(F("Max: "));
-	tft.println(s.max_age? hms(s.max_age): "");
-	tft.print(F("Ave: "));
-	tft.println(s.num_updates > 1? hms(s.total / (s.num_updates-1)): "");
-	tft.println();
-	tft.println(F("Failures"));
-	tft.print("Connect: ");
-	tft.println(s.connect_failures);
-	tft.print("Parse:   ");
-	tft.println(s.parse_failures);
-	tft.print("Memory:  ");
-	tft.println(s.mem_failures);
+
+static void compose(std::function<void()> paint) {
+	int16_t w = tft.width(), h = tft.height();
+	int16_t sh = SPRITE_BYTES / (w * 2);
+	if (sh > h)
+		sh = h;
+
+	TFT_eSprite sprite(&tft);
+	while (sh >= ICON_ROWS && !sprite.createSprite(w, sh))
+		sh /= 2;
+	if (!sprite.created()) {
+		ERR(println(F("No memory for sprite")));
+		paint();
+		return;
+	}
+#if defined(FONT)
+	sprite.setTextFont(FONT);
+#endif
+
+	gfx = &sprite;
+	if (sh < h)
+		strip_icon.pixels = (uint16_t *)malloc(ICON_W * ICON_H * sizeof(uint16_t));
+	for (int16_t y = 0; y < h; y += sh) {
+		sprite.setViewport(0, -y, w, h);
+		paint();
+		sprite.resetViewport();
+		sprite.pushSprite(0, y);
+	}
+	free(strip_icon.pixels);
+	strip_icon.pixels = 0;
+	gfx = &tft;
+	sprite.deleteSprite();
+}
+#else
+static void compose(std::function<void()> paint) {
+	paint();
+}
+#endif
+
+void display_weather(struct Conditions &c) {
+	compose([&c]() { paint_weather(c); });
+	shown = c;
+	shown_metric = cfg.metric;
+	showing = WEATHER_SCREEN;
+}
+
+// redraws only the fields of the weather screen which have changed
+void refresh_weather(struct Conditions &c) {
+	if (showing != WEATHER_SCREEN || shown_metric != cfg.metric) {
+		display_weather(c);
+		return;
+	}
+
+	uint16_t dirty = 0;
+	struct box cleared[FIELDS];
+	for (int f = 0; f < FIELDS; f++) {
+		cleared[f] = {};
+		// icons are cleared too, as they aren't all the same height
+		if (changed(f, shown, c)) {
+			dirty |= bit(f);
+			cleared[f] = boxes[f];
+		}
+	}
+	if (!dirty)
+		return;
+
+	for (int f = 0; f < FIELDS; f++) {
+		struct box &b = cleared[f];
+		if (b.w)
+			tft.fillRect(b.x, b.y, b.w, b.h, TFT_WHITE);
+	}
+
+	// fields overlapping those cleared need redrawing too, and the wind
+	// marker goes on top of everything
+	for (int f = 0; f < FIELDS; f++)
+		for (int g = 0; g < FIELDS; g++)
+			if (overlaps(boxes[f], cleared[g]))
+				dirty |= bit(f);
+	dirty |= bit(WIND);
+
+	gfx->setTextColor(TFT_BLACK);
+	for (int f = 0; f < FIELDS; f++)
+		if (dirty & bit(f))
+			draw_field(f, c);
+	shown = c;
+}
+
+void display_astronomy(struct Conditions &c) {
+	compose([&c]() { paint_astronomy(c); });
+	shown = c;
+	showing = ASTRONOMY_SCREEN;
+}
+
+void display_forecast(struct Forecast &f) {
+	compose([&f]() { paint_forecast(f); });
+	showing = OTHER;
+}
+
+void display_about(struct Statistics &s) {
+	compose([&s]() { paint_about(s); });
+	showing = OTHER;
+}
+
+// redraws the clock, if it's changed, on the screens showing it
+void refresh_time() {
+	switch (showing) {
+	case WEATHER_SCREEN:
+		refresh_weather(shown);
+		break;
+	case ASTRONOMY_SCREEN:
+		if (local_time(shown.epoch) / 60 != shown_time / 60) {
+			struct box &b = time_box;
+			tft.fillRect(b.x, b.y, b.w, b.h, TFT_BLACK);
+			tft.setTextColor(TFT_WHITE);
+			marking = &time_box;
+			*marking = {};
+			shown_time = local_time(shown.epoch);
+			display_time(shown_time, cfg.metric);
+			marking = 0;
+		}
+		break;
+	default:
+		break;
+	}
 }
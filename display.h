@@ -3,6 +3,10 @@
 extern TFT_eSPI tft;
 
 void display_weather(struct Conditions &c);
+void refresh_weather(struct Conditions &c);
+void refresh_time();
 void display_astronomy(struct Conditions &c);
 void display_forecast(struct Forecast &f);
 void display_about(struct Statistics &s);
+
+void prefetch_icon(const char *name);
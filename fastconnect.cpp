@@ -0,0 +1,165 @@
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#include <functional>
+
+#include "fastconnect.h"
+#include "state.h"
+#include "dbg.h"
+
+#define LEASE_MAGIC	0x32575747	// "GWW2"
+#define LEASE_AGE	3600	// seconds an address is reused without DHCP, less than most leases
+#define CLOCK_SET	1600000000
+#define CLOCK_TIMEOUT	120000	// ms for the clock to be set through a reused address
+#define FAST_TIMEOUT	5000
+#define SCAN_TIMEOUT	30000
+
+static const char *lease_file = "/lease.bin";
+
+// where the network was last found and the address it gave us, kept in
+// RTC memory for warm resets and LittleFS for cold ones
+struct lease {
+	uint32_t magic;
+	uint32_t ssid;
+	uint8_t bssid[6];
+	uint8_t channel;
+	uint8_t pad;
+	uint32_t ip, gateway, mask, dns1, dns2;
+	uint32_t leased;	// when DHCP gave the address, 0 until the clock's set
+	uint32_t check;
+};
+
+// the network joined, and whether its address was reused without DHCP
+static struct lease joined;
+static bool reused;
+
+// FNV-1a
+static uint32_t hash(const uint8_t *p, size_t n) {
+	uint32_t h = 2166136261;
+	while (n--) {
+		h ^= *p++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static bool valid(struct lease &l, uint32_t ssid) {
+	return l.magic == LEASE_MAGIC && l.ssid == ssid && l.check == hash((const uint8_t *)&l, offsetof(struct lease, check));
+}
+
+static bool read_lease(struct lease &l, uint32_t ssid) {
+	if (ESP.rtcUserMemoryRead(0, (uint32_t *)&l, sizeof(l)) && valid(l, ssid))
+		return true;
+
+	File f = LittleFS.open(lease_file, "r");
+	if (!f)
+		return false;
+	bool ok = f.read((uint8_t *)&l, sizeof(l)) == sizeof(l);
+	f.close();
+	return ok && valid(l, ssid);
+}
+
+static void write_lease(struct lease &l) {
+	l.check = hash((const uint8_t *)&l, offsetof(struct lease, check));
+	ESP.rtcUserMemoryWrite(0, (uint32_t *)&l, sizeof(l));
+
+	File f = LittleFS.open(lease_file, "w");
+	if (!f) {
+		ERR(println(F("Failed to save lease")));
+		return;
+	}
+	f.write((const uint8_t *)&l, sizeof(l));
+	f.close();
+}
+
+static void keep_address(struct lease &l) {
+	l.ip = WiFi.localIP();
+	l.gateway = WiFi.gatewayIP();
+	l.mask = WiFi.subnetMask();
+	l.dns1 = WiFi.dnsIP(0);
+	l.dns2 = WiFi.dnsIP(1);
+}
+
+static bool wait(uint32_t timeout, std::function<void()> &busy) {
+	uint32_t start = millis(), spun = start;
+	while (WiFi.status() != WL_CONNECTED) {
+		if (millis() - start > timeout)
+			return false;
+		if (millis() - spun >= 500) {
+			busy();
+			spun = millis();
+		}
+		delay(10);
+	}
+	return true;
+}
+
+bool fast_connect(const char *ssid, const char *password, std::function<void()> busy) {
+	uint32_t start = millis();
+	uint32_t key = hash((const uint8_t *)ssid, strlen(ssid));
+
+	// a directed association, without a scan, and the last address
+	// without DHCP if it's known when DHCP gave it; lease_check() gives
+	// it up once it's too old
+	struct lease &l = joined;
+	bool fast = read_lease(l, key);
+	reused = fast && l.leased;
+	if (fast) {
+		if (reused)
+			WiFi.config(IPAddress(l.ip), IPAddress(l.gateway), IPAddress(l.mask), IPAddress(l.dns1), IPAddress(l.dns2));
+		WiFi.begin(ssid, password, l.channel, l.bssid);
+		fast = wait(FAST_TIMEOUT, busy);
+		if (!fast) {
+			DBG(println(F("Fast connect failed, scanning")));
+			WiFi.disconnect();
+			WiFi.config(0u, 0u, 0u);
+			reused = false;
+		}
+	}
+
+	if (!fast) {
+		WiFi.begin(ssid, password);
+		if (!wait(SCAN_TIMEOUT, busy))
+			return false;
+	}
+
+	stats.wifi_connect_ms = millis() - start;
+	stats.wifi_fast = fast;
+	DBG(print(fast? F("Fast connect in "): F("Connected in ")));
+	DBG(print(stats.wifi_connect_ms));
+	DBG(println(F("ms")));
+
+	l.magic = LEASE_MAGIC;
+	l.ssid = key;
+	memcpy(l.bssid, WiFi.BSSID(), sizeof(l.bssid));
+	l.channel = WiFi.channel();
+	l.pad = 0;
+	if (!reused) {
+		keep_address(l);
+		l.leased = 0;
+	}
+	write_lease(l);
+	return true;
+}
+
+void lease_check() {
+	time_t now = time(0);
+	if (joined.magic != LEASE_MAGIC)
+		return;
+
+	if (reused) {
+		// the address may be why the clock isn't set
+		if (now < CLOCK_SET? millis() < CLOCK_TIMEOUT: now - joined.leased < LEASE_AGE)
+			return;
+		DBG(println(F("Address reused too long, asking DHCP")));
+		WiFi.config(0u, 0u, 0u);
+		reused = false;
+		joined.leased = 0;
+		write_lease(joined);
+	} else if (!joined.leased && now >= CLOCK_SET && (uint32_t)WiFi.localIP()) {
+		// DHCP gave it since boot, or since the last check
+		keep_address(joined);
+		joined.leased = now;
+		write_lease(joined);
+	}
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// joins the network, directly if where it was last found is known,
+// calling busy every half second while waiting
+bool fast_connect(const char *ssid, const char *password, std::function<void()> busy);
+
+// once the clock's set, notes when DHCP gave the address, and asks it again
+// when an address reused without it is too old; called every minute
+void lease_check();
@@ -0,0 +1,270 @@
+#include <Arduino.h>
+#include <functional>
+
+#include "inflate.h"
+#include "dbg.h"
+
+static const uint16_t length_base[] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_bits[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_bits[] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t lengths_order[] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+bool Inflate::begin() {
+	_window = (uint8_t *)malloc(INFLATE_WINDOW);
+	return _window;
+}
+
+int Inflate::byte() {
+	int c = _input();
+	if (c < 0)
+		_eof = true;
+	return c;
+}
+
+int Inflate::word() {
+	int lo = byte();
+	int hi = byte();
+	return lo | (hi << 8);
+}
+
+int Inflate::bits(int n) {
+	while (_bitcount < n) {
+		int c = byte();
+		if (c < 0)
+			return -1;
+		_bitbuf |= (uint32_t)c << _bitcount;
+		_bitcount += 8;
+	}
+	int v = _bitbuf & ((1 << n) - 1);
+	_bitbuf >>= n;
+	_bitcount -= n;
+	return v;
+}
+
+// canonical Huffman codes, a bit at a time
+int Inflate::decode(const tree &t) {
+	int sum = 0, cur = 0;
+	for (int len = 1; len < 16; len++) {
+		int b = bits(1);
+		if (b < 0)
+			return -1;
+		cur = 2 * cur + b;
+		sum += t.counts[len];
+		cur -= t.counts[len];
+		if (cur < 0)
+			return t.symbols[sum + cur];
+	}
+	return -1;
+}
+
+void Inflate::build(tree &t, const uint8_t *lengths, int n) {
+	uint16_t offsets[16];
+	memset(t.counts, 0, sizeof(t.counts));
+	for (int i = 0; i < n; i++)
+		t.counts[lengths[i]]++;
+	t.counts[0] = 0;
+
+	for (int i = 0, sum = 0; i < 16; i++) {
+		offsets[i] = sum;
+		sum += t.counts[i];
+	}
+	for (int i = 0; i < n; i++)
+		if (lengths[i])
+			t.symbols[offsets[lengths[i]]++] = i;
+}
+
+bool Inflate::header() {
+	if (byte() != 0x1f || byte() != 0x8b || byte() != 8)
+		return false;
+
+	int flags = byte();
+	for (int i = 0; i < 6; i++)	// mtime, xfl, os
+		byte();
+	if (flags & 4)
+		for (int n = word(); n > 0 && !_eof; n--)
+			byte();
+	if (flags & 8)
+		while (byte() > 0)
+			;
+	if (flags & 16)
+		while (byte() > 0)
+			;
+	if (flags & 2)
+		word();
+	return !_eof;
+}
+
+bool Inflate::block() {
+	int type = bits(3);
+	if (type < 0)
+		return false;
+
+	_last = type & 1;
+	switch (type >> 1) {
+	case 0: {
+		_bitbuf = _bitcount = 0;
+		int len = word(), nlen = word();
+		if (_eof || (len ^ 0xffff) != nlen)
+			return false;
+		_stored = len;
+		_state = STORED;
+		return true;
+	}
+	case 1: {
+		uint8_t lengths[288];
+		memset(lengths, 8, 144);
+		memset(lengths + 144, 9, 112);
+		memset(lengths + 256, 7, 24);
+		memset(lengths + 280, 8, 8);
+		build(_lit, lengths, 288);
+		memset(lengths, 5, 30);
+		build(_dists, lengths, 30);
+		_state = HUFFMAN;
+		return true;
+	}
+	case 2:
+		if (!dynamic())
+			return false;
+		_state = HUFFMAN;
+		return true;
+	}
+	return false;
+}
+
+bool Inflate::dynamic() {
+	uint8_t lengths[288 + 32];
+	int hlit = bits(5) + 257, hdist = bits(5) + 1, hclen = bits(4) + 4;
+
+	memset(lengths, 0, 19);
+	for (int i = 0; i < hclen; i++)
+		lengths[lengths_order[i]] = bits(3);
+	if (_eof || hlit > 286 || hdist > 30)
+		return false;
+
+	// the code lengths' code is built where the distances' will go
+	build(_dists, lengths, 19);
+	for (int n = 0; n < hlit + hdist; ) {
+		int sym = decode(_dists);
+		if (sym < 0)
+			return false;
+		if (sym < 16) {
+			lengths[n++] = sym;
+			continue;
+		}
+		int len = 0, rep;
+		if (sym == 16) {
+			if (!n)
+				return false;
+			len = lengths[n - 1];
+			rep = 3 + bits(2);
+		} else if (sym == 17)
+			rep = 3 + bits(3);
+		else
+			rep = 11 + bits(7);
+		if (_eof || n + rep > hlit + hdist)
+			return false;
+		while (rep--)
+			lengths[n++] = len;
+	}
+	build(_lit, lengths, hlit);
+	build(_dists, lengths + hlit, hdist);
+	return true;
+}
+
+// the CRC is left to TCP, but the length is checked
+bool Inflate::trailer() {
+	_bitbuf = _bitcount = 0;
+	for (int i = 0; i < 4; i++)
+		byte();
+	uint32_t size = word();
+	size |= (uint32_t)word() << 16;
+	return !_eof && size == _total;
+}
+
+int Inflate::fail() {
+	ERR(print(F("Inflate failed at ")));
+	ERR(println(_total));
+	_state = FAILED;
+	return -1;
+}
+
+int Inflate::read() {
+	for (;;)
+		switch (_state) {
+		case HEADER:
+			if (!header())
+				return fail();
+			_state = BLOCK;
+			break;
+		case BLOCK:
+			if (_last)
+				_state = TRAILER;
+			else if (!block())
+				return fail();
+			break;
+		case STORED:
+			if (_stored == 0)
+				_state = BLOCK;
+			else {
+				int c = byte();
+				if (c < 0)
+					return fail();
+				_stored--;
+				return out(c);
+			}
+			break;
+		case HUFFMAN: {
+			if (_copy > 0) {
+				_copy--;
+				return out(_window[(_total - _dist) & (INFLATE_WINDOW - 1)]);
+			}
+			int sym = decode(_lit);
+			if (sym < 0)
+				return fail();
+			if (sym < 256)
+				return out(sym);
+			if (sym == 256) {
+				_state = BLOCK;
+				break;
+			}
+			sym -= 257;
+			if (sym >= 29)
+				return fail();
+			int extra = bits(length_bits[sym]);
+			int d = decode(_dists);
+			if (extra < 0 || d < 0 || d >= 30)
+				return fail();
+			_copy = length_base[sym] + extra;
+			extra = bits(dist_bits[d]);
+			if (extra < 0)
+				return fail();
+			_dist = dist_base[d] + extra;
+			if (_dist > _total || _dist > INFLATE_WINDOW)
+				return fail();
+			break;
+		}
+		case TRAILER:
+			if (!trailer())
+				return fail();
+			_state = DONE;
+			break;
+		case DONE:
+		case FAILED:
+			return -1;
+		}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// deflate allows back-references up to 32k, more than the heap can spare
+// alongside everything else; a response which refers back further than
+// the window fails to inflate, but one no larger than it always inflates
+#ifndef INFLATE_WINDOW
+#define INFLATE_WINDOW	8192
+#endif
+
+// inflates a gzip stream a byte at a time, through a circular window
+class Inflate {
+public:
+	// input returns the next byte of the gzip stream, -1 at its end
+	Inflate(std::function<int()> input): _input(input) {}
+	~Inflate() { free(_window); }
+
+	bool begin();
+	int read();
+
+	bool failed() const { return _state == FAILED; }
+	uint32_t total() const { return _total; }
+
+private:
+	struct tree {
+		uint16_t counts[16];
+		uint16_t symbols[288];
+	};
+
+	enum { HEADER, BLOCK, STORED, HUFFMAN, TRAILER, DONE, FAILED } _state = HEADER;
+
+	int byte();
+	int word();
+	int bits(int n);
+	int decode(const tree &t);
+	void build(tree &t, const uint8_t *lengths, int n);
+	bool header();
+	bool block();
+	bool dynamic();
+	bool trailer();
+	int fail();
+
+	int out(uint8_t c) {
+		_window[_total++ & (INFLATE_WINDOW - 1)] = c;
+		return c;
+	}
+
+	std::function<int()> _input;
+	uint8_t *_window = 0;
+	uint32_t _total = 0;
+
+	uint32_t _bitbuf = 0;
+	uint8_t _bitcount = 0;
+	bool _eof = false, _last = false;
+
+	uint16_t _stored, _copy = 0, _dist;
+	tree _lit, _dists;
+};
@@ -1,64 +1,625 @@
 #pragma once
 
-class JsonClient {
+#include <lwip/dns.h>
+
+// connections are pooled per host and kept alive for reuse while fresh
+#define POOL_SIZE	2
+#define KEEPALIVE_IDLE	30000
+#define DRAIN_MAX	4096
+#define READ_TIMEOUT	1000
+
+// gzip is only asked for when the window to inflate it has been taken,
+// leaving this much heap
+#define INFLATE_RESERVE	8192
+
+// responses are read into memory in slices of FETCH_SLICE ms: a body of
+// known length whole, if that leaves FETCH_RESERVE bytes of heap, otherwise
+// up to FETCH_BUFFER bytes; the rest, if any, is read as it's parsed
+#define FETCH_BUFFER	4096
+#define FETCH_RESERVE	8192
+#define FETCH_SLICE	5
+#define FETCH_TIMEOUT	5000
+
+class JsonClient: public Stream {
 public:
-	JsonClient(WiFiClient &client, const __FlashStringHelper *host):
-		JsonClient(client, host, 80) {}
+	enum { BUSY, READY, FAILED };
+
+	JsonClient(const __FlashStringHelper *host):
+		JsonClient(host, 80) {}
+
+	JsonClient(const __FlashStringHelper *host, unsigned port):
+		_host(host), _port(port) {}
+
+	~JsonClient() { end(); }
+
+	// starts a request, which each call to poll() then advances
+	bool start(std::function<void(Stream &)> add_path) {
+
+		stats.http_requests++;
+		_add_path = add_path;
+		_since = millis();
+		_reused = reuse();
+		_step = _reused? SENDING: RESOLVING;
+		if (!_reused && !resolve()) {
+			stop();
+			return false;
+		}
+		return true;
+	}
+
+	int poll() {
+
+		uint32_t now = millis();
+		switch (_step) {
+		case RESOLVING:
+			if (_conn->dns == RESOLVING_HOST) {
+				if (now - _since < FETCH_TIMEOUT)
+					return BUSY;
+				ERR(print(F("Timeout resolving ")));
+				ERR(println(_host));
+				_conn->dns = UNRESOLVED;
+				return failed();
+			}
+			if (_conn->dns != RESOLVED) {
+				ERR(print(F("Failed to resolve ")));
+				ERR(println(_host));
+				return failed();
+			}
+			if (!connect())
+				return failed();
+			_step = SENDING;
+			return BUSY;
+
+		case SENDING:
+			if (!send())
+				return retry();
+			_step = RECEIVING;
+			_since = now;
+			return BUSY;
+
+		case RECEIVING:
+			return receive(now);
+
+		case BUFFERING:
+			return buffer(now);
+
+		case RECEIVED:
+			return READY;
+		}
+		return FAILED;
+	}
+
+	// from the last response
+	int status() const { return _status; }
+	time_t date() const { return _date; }
+	const char *etag() const { return _etag; }
+
+	// seconds for which the response is fresh, -1 if not given
+	long max_age() const {
+		if (_max_age >= 0)
+			return _max_age;
+		if (_expires && _date)
+			return _expires > _date? _expires - _date: 0;
+		return -1;
+	}
+
+	// finishes with the response, keeping the connection if it can be reused
+	void end() {
+
+		if (!_conn)
+			return;
+
+		if (_inflate) {
+			if (_inflate->failed()) {
+				ERR(print(F("Not asking for gzip from ")));
+				ERR(println(_host));
+				_conn->plain = true;
+			}
+			stats.inflated_bytes = _inflate->total();
+			stats.inflate_us = _inflate_us > _wait_us? _inflate_us - _wait_us: 0;
+		}
+		release();
+
+		// a chunked body's length isn't known up front, so it's counted as it's drained
+		bool reusable = _step == RECEIVED && !_close
+			&& (_chunked || (_remaining >= 0 && _remaining <= DRAIN_MAX));
+		uint32_t start = millis(), drained = 0;
+		while (reusable && fill())
+			if (raw_read() < 0) {
+				if (!_conn->client.connected() || millis() - start > READ_TIMEOUT)
+					reusable = false;
+				else
+					yield();
+			} else if (++drained > DRAIN_MAX)
+				reusable = false;
+
+		stats.rx_bytes = _rx;
+		if (reusable)
+			_conn->used = millis();
+		else
+			_conn->client.stop();
+		_conn = 0;
+	}
 
-	JsonClient(WiFiClient &client, const __FlashStringHelper *host, unsigned port):
-		_client(client), _host(host), _port(port) {}
+	// the response body, inflated if necessary
+	int available() {
+		if (_inflate)
+			return peek() >= 0;
+		int n = _buf_len - _buf_pos;
+		if (!fill())
+			return n;
+		int a = _conn->client.available();
+		return n + (_remaining >= 0 && a > _remaining? _remaining: a);
+	}
 
-	bool get(const char *path) {
+	int read() {
+		if (!_inflate)
+			return next();
+		if (_peeked >= 0) {
+			int c = _peeked;
+			_peeked = -1;
+			return c;
+		}
+		uint32_t start = micros();
+		int c = _inflate->read();
+		_inflate_us += micros() - start;
+		return c;
+	}
 
-		return get([path](Stream &s) { s.print(path); });
+	int peek() {
+		if (_inflate) {
+			if (_peeked < 0)
+				_peeked = read();
+			return _peeked;
+		}
+		if (_buf_pos < _buf_len)
+			return _buf[_buf_pos];
+		if (!fill())
+			return -1;
+		return _conn->client.peek();
 	}
 
-	bool get(std::function<void(Stream &)> add_path) {
+	size_t write(uint8_t) { return 0; }
+
+private:
+	enum { RESOLVING, SENDING, RECEIVING, BUFFERING, RECEIVED, BROKEN };
+	enum { UNRESOLVED, RESOLVING_HOST, RESOLVED };
+
+	struct connection {
+		char host[32];
+		unsigned port;
+		uint32_t used;
+		bool plain;	// gzip failed, don't ask again
+		volatile uint8_t dns;
+		IPAddress ip;
+		WiFiClient client;
+	};
+
+	static connection *pool() {
+		static connection connections[POOL_SIZE];
+		return connections;
+	}
+
+	bool reuse() {
+		connection *lru = 0;
+		for (int i = 0; i < POOL_SIZE; i++) {
+			connection &c = pool()[i];
+			if (c.port == _port && !strcmp_P(c.host, (PGM_P)_host)) {
+				_conn = &c;
+				if (c.client.connected() && millis() - c.used < KEEPALIVE_IDLE)
+					return true;
+				return false;
+			}
+			if (!lru || c.used < lru->used)
+				lru = &c;
+		}
+		_conn = lru;
+		_conn->client.stop();
+		strncpy_P(_conn->host, (PGM_P)_host, sizeof(_conn->host));
+		_conn->port = _port;
+		_conn->plain = false;
+		_conn->dns = UNRESOLVED;
+		return false;
+	}
+
+	static void resolved(const char *name, const ip_addr_t *addr, void *arg) {
+		connection *c = (connection *)arg;
+		if (addr) {
+			c->ip = IPAddress(addr);
+			c->dns = RESOLVED;
+		} else
+			c->dns = UNRESOLVED;
+	}
 
-		if (!_client.connect(_host, _port)) {
+	// looks up the host without waiting, lwIP calls back when it's found
+	bool resolve() {
+		ip_addr_t addr;
+		_conn->dns = RESOLVING_HOST;
+		switch (dns_gethostbyname(*cfg.server? cfg.server: _conn->host, &addr, resolved, _conn)) {
+		case ERR_OK:
+			resolved(_conn->host, &addr, _conn);
+			return true;
+		case ERR_INPROGRESS:
+			return true;
+		}
+		ERR(print(F("Failed to look up ")));
+		ERR(println(_host));
+		_conn->dns = UNRESOLVED;
+		return false;
+	}
+
+	bool connect() {
+
+		_conn->client.stop();
+		_conn->used = millis();
+		stats.http_connects++;
+		if (!_conn->client.connect(_conn->ip, *cfg.server? cfg.server_port: _port)) {
 			ERR(print(F("Failed to connect: ")));
 			ERR(print(_host));
 			ERR(print(':'));
 			ERR(print(_port));
+			stats.connect_failures++;
 			return false;
 		}
-		_client.print(F("GET "));
+		return true;
+	}
+
+	void release() {
+		delete _inflate;
+		_inflate = 0;
+		free(_buf);
+		_buf = 0;
+		_buf_len = _buf_pos = 0;
+	}
+
+	void stop() {
+		release();
+		if (_conn) {
+			_conn->client.stop();
+			_conn = 0;
+		}
+	}
+
+	int failed() {
+		stop();
+		_step = BROKEN;
+		return FAILED;
+	}
+
+	// the server has closed a kept-alive connection since it was last used
+	int retry() {
+		if (!_reused)
+			return failed();
+		DBG(println(F("Reconnecting")));
+		_reused = false;
+		if (!connect())
+			return failed();
+		_step = SENDING;
+		return BUSY;
+	}
+
+	bool send() {
 
-		add_path(_client);
+		WiFiClient &client = _conn->client;
+		client.print(F("GET "));
 
-		_client.println(F(" HTTP/1.1"));
-		_client.print(F("Host: "));
-		_client.println(_host);
-		_client.println(F("Connection: close"));
-		_client.println(F("Accept: application/json"));
-		_client.println();
+		_add_path(client);
 
-		if (!_client.connected()) {
+		client.println(F(" HTTP/1.1"));
+		client.print(F("Host: "));
+		client.println(_host);
+		client.println(F("Connection: keep-alive"));
+		client.println(F("Accept: application/json"));
+		if (!_conn->plain && reserve_inflate())
+			client.println(F("Accept-Encoding: gzip"));
+		client.println();
+
+		if (!client.connected()) {
 			ERR(print(F("Not connected")));
 			return false;
 		}
 
-		unsigned long now = millis();
-		while (!_client.available())
-			if (millis() - now > 5000) {
+		_remaining = -1;
+		_chunked = _close = _eof = _gzip = false;
+		_chunks = _lines = _line_len = 0;
+		_rx = 0;
+		_status = 0;
+		_max_age = -1;
+		_date = _expires = 0;
+		*_etag = 0;
+		return true;
+	}
+
+	// reads the status line and headers, as much as has arrived
+	int receive(uint32_t now) {
+
+		WiFiClient &client = _conn->client;
+		if (!client.available()) {
+			if (!client.connected())
+				return _rx? failed(): retry();
+			if (now - _since > FETCH_TIMEOUT) {
 				ERR(println(F("Timeout waiting for server!")));
-				return false;
+				return failed();
 			}
+			return BUSY;
+		}
 
-		while (_client.available()) {
-			int c = _client.peek();
-			if (c == '{' || c == '[')
-				return true;
-			_client.read();
+		_since = now;
+		while (client.available() && millis() - now < FETCH_SLICE) {
+			int c = client.read();
+			_rx++;
+			if (c != '\n') {
+				if (c != '\r' && _line_len < sizeof(_line) - 1)
+					_line[_line_len++] = c;
+				continue;
+			}
+			_line[_line_len] = 0;
+			_line_len = 0;
+			if (_lines++ == 0) {
+				if (!status_line())
+					return failed();
+			} else if (*_line)
+				header();
+			else
+				return headers_received();
 		}
+		return BUSY;
+	}
 
-		ERR(println(F("Unexpected EOF reading server response!")));
+	bool status_line() {
+		const char *code = strchr(_line, ' ');
+		if (strncmp_P(_line, PSTR("HTTP/1."), 7) || !code) {
+			ERR(print(F("Bad status line: ")));
+			ERR(println(_line));
+			return false;
+		}
+		_status = atoi(code);
+		return true;
+	}
+
+	// for how the body is framed, how long it's fresh and which version it is
+	void header() {
+		char *value = strchr(_line, ':');
+		if (!value)
+			return;
+		*value++ = 0;
+		while (*value == ' ')
+			value++;
+		if (!strcasecmp_P(_line, PSTR("Content-Length")))
+			_remaining = atol(value);
+		else if (!strcasecmp_P(_line, PSTR("Transfer-Encoding")))
+			_chunked = strstr_P(value, PSTR("chunked"));
+		else if (!strcasecmp_P(_line, PSTR("Connection")))
+			_close = !strcasecmp_P(value, PSTR("close"));
+		else if (!strcasecmp_P(_line, PSTR("Cache-Control"))) {
+			const char *m = strstr_P(value, PSTR("max-age="));
+			if (m)
+				_max_age = atol(m + 8);
+			else if (strstr_P(value, PSTR("no-")))
+				_max_age = 0;
+		} else if (!strcasecmp_P(_line, PSTR("Expires")))
+			_expires = http_date(value);
+		else if (!strcasecmp_P(_line, PSTR("Date")))
+			_date = http_date(value);
+		else if (!strcasecmp_P(_line, PSTR("ETag")))
+			strlcpy(_etag, value, sizeof(_etag));
+		else if (!strcasecmp_P(_line, PSTR("Content-Encoding")))
+			_gzip = !strcasecmp_P(value, PSTR("gzip"));
+	}
+
+	// fails fast on an error response, leaving the connection to be reused
+	// if its body can be drained
+	int headers_received() {
+
+		if (_chunked)
+			_remaining = 0;
+		// the window is only kept for a gzipped body
+		if (!_gzip || _status < 200 || _status >= 300) {
+			delete _inflate;
+			_inflate = 0;
+		}
+		if (_status < 200 || _status >= 300) {
+			ERR(print(F("HTTP status ")));
+			ERR(print(_status));
+			ERR(print(F(" from ")));
+			ERR(println(_host));
+			_step = RECEIVED;
+			end();
+			_step = BROKEN;
+			return FAILED;
+		}
+
+		if (_gzip && !inflate())
+			return failed();
+
+		_buf_size = FETCH_BUFFER;
+		if (!_chunked && _remaining >= 0 && (_remaining < FETCH_BUFFER
+				|| ESP.getMaxFreeBlockSize() >= (uint32_t)_remaining + FETCH_RESERVE))
+			_buf_size = _remaining;
+		_buf = (uint8_t *)malloc(_buf_size);
+		_step = BUFFERING;
+		return BUSY;
+	}
+
+	// reads as much of the body as has arrived into memory
+	int buffer(uint32_t now) {
+
+		WiFiClient &client = _conn->client;
+		while (_buf && _buf_len < _buf_size && client.available() && millis() - now < FETCH_SLICE) {
+			if (!fill())
+				break;
+			int c = raw_read();
+			if (c < 0)
+				break;
+			_buf[_buf_len++] = c;
+			_since = now;
+		}
+
+		if (!_buf || _buf_len == _buf_size || _eof || (!_chunked && _remaining == 0)
+				|| (!client.connected() && !client.available())) {
+			_step = RECEIVED;
+			return READY;
+		}
+		if (now - _since > FETCH_TIMEOUT) {
+			ERR(println(F("Timeout reading response!")));
+			return failed();
+		}
+		return BUSY;
+	}
+
+	// parses an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+	static time_t http_date(const char *s) {
+		static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+		char mon[4];
+		int d, y, h, m, sec;
+		if (sscanf(s, "%*3s, %d %3s %d %d:%d:%d", &d, mon, &y, &h, &m, &sec) != 6)
+			return 0;
+		const char *p = strstr(months, mon);
+		if (!p)
+			return 0;
+		tmElements_t tm;
+		tm.Year = CalendarYrToTm(y);
+		tm.Month = (p - months) / 3 + 1;
+		tm.Day = d;
+		tm.Hour = h;
+		tm.Minute = m;
+		tm.Second = sec;
+		return makeTime(tm);
+	}
+
+	// takes the window before asking for gzip, otherwise the response couldn't be read
+	bool reserve_inflate() {
+		if (_inflate)
+			return true;
+		if (ESP.getMaxFreeBlockSize() < INFLATE_WINDOW + INFLATE_RESERVE)
+			return false;
+		_inflate = new Inflate([this]() { return body_read(); });
+		if (_inflate->begin())
+			return true;
+		delete _inflate;
+		_inflate = 0;
 		return false;
 	}
 
-private:
-	WiFiClient &_client;
+	bool inflate() {
+		if (!_inflate) {
+			ERR(println(F("Gzipped response not asked for")));
+			return false;
+		}
+		_peeked = -1;
+		_inflate_us = _wait_us = 0;
+		return true;
+	}
+
+	// the next byte of the compressed body, waiting for it if necessary
+	int body_read() {
+		uint32_t start = micros();
+		int c;
+		while ((c = next()) < 0 && fill() && micros() - start < READ_TIMEOUT * 1000)
+			yield();
+		_wait_us += micros() - start;
+		return c;
+	}
+
+	// the next byte of the body, from memory then the connection
+	int next() {
+		if (_buf_pos < _buf_len)
+			return _buf[_buf_pos++];
+		return raw_read();
+	}
+
+	int raw_read() {
+		if (!fill())
+			return -1;
+		int c = _conn->client.read();
+		if (c >= 0) {
+			_rx++;
+			if (_remaining > 0)
+				_remaining--;
+		}
+		return c;
+	}
+
+	int timed_read() {
+		unsigned long now = millis();
+		do {
+			int c = _conn->client.read();
+			if (c >= 0) {
+				_rx++;
+				return c;
+			}
+			yield();
+		} while (millis() - now < READ_TIMEOUT);
+		return -1;
+	}
+
+	// reads a line without its CRLF, truncated to fit
+	bool read_line(char *buf, size_t n) {
+		size_t i = 0;
+		for (;;) {
+			int c = timed_read();
+			if (c < 0)
+				return false;
+			if (c == '\n')
+				break;
+			if (c != '\r' && i < n - 1)
+				buf[i++] = c;
+		}
+		buf[i] = 0;
+		return true;
+	}
+
+	// readies the next byte of the body on the connection, false at its end
+	bool fill() {
+		if (!_conn || _eof)
+			return false;
+
+		if (_remaining == 0) {
+			if (_chunked) {
+				char line[16];
+				if (_chunks++ > 0 && !read_line(line, sizeof(line)))
+					return false;
+				if (!read_line(line, sizeof(line)))
+					return false;
+				_remaining = strtol(line, 0, 16);
+				if (_remaining > 0)
+					return true;
+				// skip any trailers
+				while (read_line(line, sizeof(line)) && *line)
+					;
+			}
+			_eof = true;
+			return false;
+		}
+		return true;
+	}
+
 	const __FlashStringHelper *_host;
 	const unsigned _port;
-};
+	connection *_conn = 0;
+
+	std::function<void(Stream &)> _add_path;
+	uint8_t _step = BROKEN;
+	bool _reused;
+	uint32_t _since;
+
+	char _line[128];
+	unsigned _line_len, _lines;
 
+	uint8_t *_buf = 0;
+	unsigned _buf_size, _buf_len = 0, _buf_pos = 0;
+
+	long _remaining;	// in the body or current chunk, -1 if unknown
+	bool _chunked, _close, _eof;
+	unsigned _chunks;
+
+	int _status;
+	long _max_age;
+	time_t _date, _expires;
+	char _etag[48];
+
+	Inflate *_inflate = 0;
+	int _peeked;
+	uint32_t _inflate_us, _wait_us, _rx;
+	bool _gzip;
+};
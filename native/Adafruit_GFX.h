@@ -0,0 +1,3 @@
+#pragma once
+
+// nothing's drawn through Adafruit_GFX
@@ -0,0 +1,409 @@
+#include <Arduino.h>
+#include <unistd.h>
+
+#include "native.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static uint64_t now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t boot_us = now_us();
+
+// the virtual clock, when it's running, in us since boot
+static bool virtual_clock;
+static uint64_t virtual_us, virtual_start_us;
+static time_t virtual_epoch;
+
+void clock_virtual(uint32_t ms, time_t epoch) {
+	virtual_clock = true;
+	virtual_us = virtual_start_us = (uint64_t)ms * 1000;
+	virtual_epoch = epoch;
+}
+
+void clock_advance(uint32_t ms) {
+	virtual_us += (uint64_t)ms * 1000;
+}
+
+uint32_t millis() {
+	return (virtual_clock? virtual_us: now_us() - boot_us) / 1000;
+}
+
+uint32_t micros() {
+	return virtual_clock? virtual_us: now_us() - boot_us;
+}
+
+void delay(uint32_t ms) {
+	if (virtual_clock)
+		clock_advance(ms);
+	else
+		usleep(ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+	if (virtual_clock)
+		virtual_us += us;
+	else
+		usleep(us);
+}
+
+// linked with --wrap=time, so the sketch's time(0) follows the virtual clock
+extern "C" {
+time_t __real_time(time_t *t);
+
+time_t __wrap_time(time_t *t) {
+	if (!virtual_clock)
+		return __real_time(t);
+	time_t now = virtual_epoch + (virtual_us - virtual_start_us) / 1000000;
+	if (t)
+		*t = now;
+	return now;
+}
+}
+
+void configTime(int timezone, int dst, const char *server1, const char *server2, const char *server3) {
+}
+
+void yield() {
+}
+
+#if !defined(__GLIBC__) || __GLIBC__ == 2 && __GLIBC_MINOR__ < 38
+size_t strlcpy(char *dst, const char *src, size_t size) {
+	size_t n = strlen(src);
+	if (size) {
+		size_t k = min(n, size - 1);
+		memcpy(dst, src, k);
+		dst[k] = 0;
+	}
+	return n;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size) {
+	size_t n = strnlen(dst, size);
+	return n == size? n + strlen(src): n + strlcpy(dst + n, src, size - n);
+}
+#endif
+
+long random(long max) {
+	return max > 0? ::random() % max: 0;
+}
+
+long random(long min, long max) {
+	return min < max? min + random(max - min): min;
+}
+
+void randomSeed(unsigned long seed) {
+	srandom(seed);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int digitalRead(uint8_t pin) { return HIGH; }
+void analogWrite(uint8_t pin, int value) {}
+
+static void (*handlers[NUM_PINS])();
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode) {
+	if (pin < NUM_PINS)
+		handlers[pin] = handler;
+}
+
+void interrupt(uint8_t pin) {
+	if (pin < NUM_PINS && handlers[pin])
+		handlers[pin]();
+}
+
+size_t Print::write(const uint8_t *buf, size_t n) {
+	size_t w = 0;
+	while (n--)
+		w += write(*buf++);
+	return w;
+}
+
+size_t Print::print(const String &s) {
+	return write(s.c_str(), s.length());
+}
+
+size_t Print::print(long n, int base) {
+	if (n < 0 && base == DEC)
+		return print('-') + print((unsigned long)-n, base);
+	return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+	return print((unsigned long long)n, base);
+}
+
+size_t Print::print(long long n, int base) {
+	if (n < 0 && base == DEC)
+		return print('-') + print((unsigned long long)-n, base);
+	return print((unsigned long long)n, base);
+}
+
+size_t Print::print(unsigned long long n, int base) {
+	char buf[65], *p = buf + sizeof(buf) - 1;
+	if (base < 2)
+		base = DEC;
+	*p = 0;
+	do {
+		int d = n % base;
+		*--p = d < 10? '0' + d: 'A' + d - 10;
+		n /= base;
+	} while (n);
+	return write(p);
+}
+
+size_t Print::print(double n, int digits) {
+	if (isnan(n))
+		return print("nan");
+	if (isinf(n))
+		return print("inf");
+	char buf[40];
+	snprintf(buf, sizeof(buf), "%.*f", digits, n);
+	return print(buf);
+}
+
+size_t Print::printf(const char *format, ...) {
+	char buf[256];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	return n < 0? 0: write(buf, min((size_t)n, sizeof(buf) - 1));
+}
+
+size_t Print::printf_P(const char *format, ...) {
+	char buf[256];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	return n < 0? 0: write(buf, min((size_t)n, sizeof(buf) - 1));
+}
+
+static std::string number(unsigned long long n, unsigned char base, bool negative) {
+	std::string s;
+	if (base < 2)
+		base = DEC;
+	do {
+		int d = n % base;
+		s.insert(s.begin(), d < 10? '0' + d: 'a' + d - 10);
+		n /= base;
+	} while (n);
+	if (negative)
+		s.insert(s.begin(), '-');
+	return s;
+}
+
+String::String(int n, unsigned char base): String((long)n, base) {}
+
+String::String(unsigned n, unsigned char base): String((unsigned long)n, base) {}
+
+String::String(long n, unsigned char base):
+	_s(n < 0 && base == DEC? number(-n, base, true): number((unsigned long)n, base, false)) {}
+
+String::String(unsigned long n, unsigned char base): _s(number(n, base, false)) {}
+
+String::String(double n, unsigned char digits) {
+	char buf[40];
+	snprintf(buf, sizeof(buf), "%.*f", digits, n);
+	_s = buf;
+}
+
+int String::indexOf(char c, unsigned from) const {
+	size_t i = _s.find(c, from);
+	return i == std::string::npos? -1: i;
+}
+
+int String::indexOf(const char *s, unsigned from) const {
+	size_t i = _s.find(s, from);
+	return i == std::string::npos? -1: i;
+}
+
+int String::lastIndexOf(char c) const {
+	size_t i = _s.rfind(c);
+	return i == std::string::npos? -1: i;
+}
+
+bool String::endsWith(const String &s) const {
+	return _s.length() >= s._s.length() && !_s.compare(_s.length() - s._s.length(), s._s.length(), s._s);
+}
+
+String String::substring(unsigned from, unsigned to) const {
+	if (from > to)
+		std::swap(from, to);
+	if (from >= _s.length())
+		return String();
+	return String(_s.substr(from, to - from));
+}
+
+void String::trim() {
+	size_t b = _s.find_first_not_of(" \t\r\n");
+	if (b == std::string::npos) {
+		_s.clear();
+		return;
+	}
+	_s = _s.substr(b, _s.find_last_not_of(" \t\r\n") - b + 1);
+}
+
+void String::toLowerCase() {
+	for (char &c: _s)
+		c = tolower(c);
+}
+
+void String::toUpperCase() {
+	for (char &c: _s)
+		c = toupper(c);
+}
+
+void String::replace(const String &from, const String &to) {
+	if (from._s.empty())
+		return;
+	for (size_t i = 0; (i = _s.find(from._s, i)) != std::string::npos; i += to._s.length())
+		_s.replace(i, from._s.length(), to._s);
+}
+
+void String::remove(unsigned index, unsigned count) {
+	if (index < _s.length())
+		_s.erase(index, count);
+}
+
+int Stream::timedRead() {
+	uint32_t start = millis();
+	do {
+		int c = read();
+		if (c >= 0)
+			return c;
+		yield();
+	} while (millis() - start < _timeout);
+	return -1;
+}
+
+int Stream::timedPeek() {
+	uint32_t start = millis();
+	do {
+		int c = peek();
+		if (c >= 0)
+			return c;
+		yield();
+	} while (millis() - start < _timeout);
+	return -1;
+}
+
+size_t Stream::readBytes(char *buf, size_t n) {
+	size_t i = 0;
+	for (int c; i < n && (c = timedRead()) >= 0; i++)
+		buf[i] = c;
+	return i;
+}
+
+// false if the terminator comes first
+bool Stream::findUntil(const char *target, const char *terminator) {
+	size_t t = 0, tlen = strlen(target);
+	size_t u = 0, ulen = terminator? strlen(terminator): 0;
+	if (!tlen)
+		return true;
+	for (int c; (c = timedRead()) >= 0; ) {
+		if (c == target[t]) {
+			if (++t == tlen)
+				return true;
+		} else
+			t = c == target[0];
+		if (ulen) {
+			if (c == terminator[u]) {
+				if (++u == ulen)
+					return false;
+			} else
+				u = c == terminator[0];
+		}
+	}
+	return false;
+}
+
+String Stream::readString() {
+	String s;
+	for (int c; (c = timedRead()) >= 0; )
+		s += (char)c;
+	return s;
+}
+
+String Stream::readStringUntil(char terminator) {
+	String s;
+	for (int c; (c = timedRead()) >= 0 && c != terminator; )
+		s += (char)c;
+	return s;
+}
+
+long Stream::parseInt() {
+	int c;
+	while ((c = timedPeek()) >= 0 && c != '-' && !isdigit(c))
+		read();
+	bool negative = c == '-';
+	if (negative)
+		read();
+	long n = 0;
+	while ((c = timedPeek()) >= 0 && isdigit(c)) {
+		n = 10 * n + c - '0';
+		read();
+	}
+	return negative? -n: n;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+	return fwrite(&c, 1, 1, stderr);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+	return fwrite(buf, 1, n, stderr);
+}
+
+void HardwareSerial::flush() {
+	fflush(stderr);
+}
+
+uint32_t EspClass::getFreeHeap() {
+	return heap_free();
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+	return heap_max_block();
+}
+
+uint8_t EspClass::getHeapFragmentation() {
+	uint32_t free = heap_free();
+	return free? 100 - 100 * heap_max_block() / free: 0;
+}
+
+void EspClass::getHeapStats(uint32_t *free, uint32_t *max, uint8_t *frag) {
+	if (free)
+		*free = getFreeHeap();
+	if (max)
+		*max = getMaxFreeBlockSize();
+	if (frag)
+		*frag = getHeapFragmentation();
+}
+
+void EspClass::restart() {
+	fprintf(stderr, "ESP.restart()\n");
+	exit(2);
+}
+
+static uint32_t rtc_memory[128];
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+	if (offset * 4 + size > sizeof(rtc_memory))
+		return false;
+	memcpy(data, rtc_memory + offset, size);
+	return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+	if (offset * 4 + size > sizeof(rtc_memory))
+		return false;
+	memcpy(rtc_memory + offset, data, size);
+	return true;
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+// stand-ins for the parts of the ESP8266 Arduino core the sketch uses,
+// for building it on Linux
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#define PROGMEM
+#define PSTR(s)		(s)
+#define F(s)		((const __FlashStringHelper *)(s))
+#define FPSTR(p)	((const __FlashStringHelper *)(p))
+#define PGM_P		const char *
+#define pgm_read_byte(p)	(*(const uint8_t *)(p))
+#define pgm_read_word(p)	(*(const uint16_t *)(p))
+#define pgm_read_dword(p)	(*(const uint32_t *)(p))
+#define pgm_read_float(p)	(*(const float *)(p))
+#define pgm_read_ptr(p)		(*(const void * const *)(p))
+#define strlen_P	strlen
+#define strcmp_P	strcmp
+#define strncmp_P	strncmp
+#define strcasecmp_P	strcasecmp
+#define strstr_P	strstr
+#define strcpy_P	strcpy
+#define strncpy_P	strncpy
+#define memcpy_P	memcpy
+#define sprintf_P	sprintf
+#define snprintf_P	snprintf
+
+// in newlib, but only in glibc since 2.38
+#if !defined(__GLIBC__) || __GLIBC__ == 2 && __GLIBC_MINOR__ < 38
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#endif
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+#define LOW		0
+#define HIGH		1
+#define INPUT		0
+#define OUTPUT		1
+#define INPUT_PULLUP	2
+#define RISING		1
+#define FALLING		2
+#define CHANGE		3
+
+// the D1 mini's, as GPIOs
+#define D0		16
+#define D1		5
+#define D2		4
+#define D3		0
+#define D4		2
+#define D5		14
+#define D6		12
+#define D7		13
+#define D8		15
+#define NUM_PINS	17
+
+#define DEC	10
+#define HEX	16
+#define OCT	8
+#define BIN	2
+
+#ifndef PI
+#define PI	3.1415926535897932384626433832795
+#endif
+#define DEG_TO_RAD	0.017453292519943295769236907684886
+#define RAD_TO_DEG	57.295779513082320876798154814105
+#define bit(b)	(1UL << (b))
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// 32 bits, as on the ESP8266, so it wraps after 49 days
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+#define digitalPinToInterrupt(p)	(p)
+
+// the time is the host's, or the virtual clock's
+void configTime(int timezone, int dst, const char *server1, const char *server2 = 0, const char *server3 = 0);
+
+class __FlashStringHelper;
+class String;
+class Print;
+
+class Printable {
+public:
+	virtual ~Printable() {}
+	virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+public:
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buf, size_t n);
+	size_t write(const char *s) { return s? write((const uint8_t *)s, strlen(s)): 0; }
+	size_t write(const char *buf, size_t n) { return write((const uint8_t *)buf, n); }
+	virtual int availableForWrite() { return 0; }
+	virtual void flush() {}
+
+	size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+	size_t print(const String &s);
+	size_t print(const Printable &p) { return p.printTo(*this); }
+	size_t print(const char *s) { return write(s); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(int n, int base = DEC) { return print((long)n, base); }
+	size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(long long n, int base = DEC);
+	size_t print(unsigned long long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+
+	template<typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+	template<typename T> size_t println(T v, int f) { size_t n = print(v, f); return n + println(); }
+	size_t println() { return write("\r\n"); }
+
+	size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+	size_t printf_P(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class String {
+public:
+	String(const char *s = "") { if (s) _s = s; }
+	String(const __FlashStringHelper *s): String((const char *)s) {}
+	String(const std::string &s): _s(s) {}
+	explicit String(char c): _s(1, c) {}
+	explicit String(int n, unsigned char base = DEC);
+	explicit String(unsigned n, unsigned char base = DEC);
+	explicit String(long n, unsigned char base = DEC);
+	explicit String(unsigned long n, unsigned char base = DEC);
+	explicit String(double n, unsigned char digits = 2);
+
+	const char *c_str() const { return _s.c_str(); }
+	unsigned length() const { return _s.length(); }
+	bool reserve(unsigned n) { _s.reserve(n); return true; }
+	bool isEmpty() const { return _s.empty(); }
+
+	bool concat(const char *s) { if (s) _s += s; return true; }
+	bool concat(const char *s, unsigned n) { if (s) _s.append(s, n); return true; }
+	bool concat(const String &s) { _s += s._s; return true; }
+	bool concat(char c) { _s += c; return true; }
+	String &operator+=(const char *s) { concat(s); return *this; }
+	String &operator+=(const String &s) { concat(s); return *this; }
+	String &operator+=(char c) { concat(c); return *this; }
+	friend String operator+(const String &a, const String &b) { return String(a._s + b._s); }
+	friend String operator+(const String &a, const char *b) { return String(a._s + (b? b: "")); }
+
+	bool equals(const String &s) const { return _s == s._s; }
+	bool equals(const char *s) const { return _s == (s? s: ""); }
+	bool equalsIgnoreCase(const String &s) const { return !strcasecmp(c_str(), s.c_str()); }
+	bool operator==(const String &s) const { return equals(s); }
+	bool operator==(const char *s) const { return equals(s); }
+	bool operator!=(const String &s) const { return !equals(s); }
+	bool operator!=(const char *s) const { return !equals(s); }
+	bool operator<(const String &s) const { return _s < s._s; }
+
+	char charAt(unsigned i) const { return i < _s.length()? _s[i]: 0; }
+	char operator[](unsigned i) const { return charAt(i); }
+	char &operator[](unsigned i) { return _s[i]; }
+
+	int indexOf(char c, unsigned from = 0) const;
+	int indexOf(const char *s, unsigned from = 0) const;
+	int lastIndexOf(char c) const;
+	bool startsWith(const String &s) const { return !_s.compare(0, s._s.length(), s._s); }
+	bool endsWith(const String &s) const;
+	String substring(unsigned from) const { return substring(from, _s.length()); }
+	String substring(unsigned from, unsigned to) const;
+
+	void trim();
+	void toLowerCase();
+	void toUpperCase();
+	void replace(const String &from, const String &to);
+	void remove(unsigned index, unsigned count = (unsigned)-1);
+	long toInt() const { return atol(c_str()); }
+	float toFloat() const { return atof(c_str()); }
+
+private:
+	std::string _s;
+};
+
+class StringSumHelper: public String {
+	using String::String;
+};
+
+class Stream: public Print {
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+
+	void setTimeout(unsigned long ms) { _timeout = ms; }
+	unsigned long getTimeout() const { return _timeout; }
+
+	// these wait for up to the timeout for each byte
+	size_t readBytes(char *buf, size_t n);
+	size_t readBytes(uint8_t *buf, size_t n) { return readBytes((char *)buf, n); }
+	bool find(const char *target) { return findUntil(target, 0); }
+	bool find(char c) { char s[] = { c, 0 }; return find(s); }
+	bool findUntil(const char *target, const char *terminator);
+	String readString();
+	String readStringUntil(char terminator);
+	long parseInt();
+
+protected:
+	int timedRead();
+	int timedPeek();
+
+	unsigned long _timeout = 1000;
+};
+
+class HardwareSerial: public Stream {
+public:
+	void begin(unsigned long baud) {}
+	void end() {}
+	void setDebugOutput(bool) {}
+
+	size_t write(uint8_t c);
+	size_t write(const uint8_t *buf, size_t n);
+	using Print::write;
+	int available() { return 0; }
+	int read() { return -1; }
+	int peek() { return -1; }
+	void flush();
+};
+
+// on stderr, so results on stdout can be piped
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+	uint32_t getFreeHeap();
+	uint32_t getMaxFreeBlockSize();
+	uint8_t getHeapFragmentation();
+	void getHeapStats(uint32_t *free, uint32_t *max, uint8_t *frag);
+
+	uint32_t getCycleCount() { return micros() * 80; }
+	uint32_t getChipId() { return 0x00c0ffee; }
+	const char *getResetReason() { return "Native"; }
+	void restart();
+
+	// RTC user memory survives restarts within the process
+	bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+	bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+};
+
+extern EspClass ESP;
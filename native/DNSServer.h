@@ -0,0 +1,12 @@
+#pragma once
+
+// the captive portal's DNS, which never gets a query
+
+#include <ESP8266WiFi.h>
+
+class DNSServer {
+public:
+	bool start(uint16_t port, const String &domain, const IPAddress &ip) { return true; }
+	void processNextRequest() {}
+	void stop() {}
+};
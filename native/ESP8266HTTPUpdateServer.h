@@ -0,0 +1,11 @@
+#pragma once
+
+// firmware can't be updated
+
+class ESP8266WebServer;
+
+class ESP8266HTTPUpdateServer {
+public:
+	void setup(ESP8266WebServer *server) {}
+	void setup(ESP8266WebServer *server, const char *path) {}
+};
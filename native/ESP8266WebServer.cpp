@@ -0,0 +1,34 @@
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+
+#include "native.h"
+
+static ESP8266WebServer *instance;
+
+ESP8266WebServer::ESP8266WebServer(int port) {
+	instance = this;
+}
+
+void ESP8266WebServer::send(int code, const char *type, const String &content) {
+	_code = code;
+	if (_response)
+		*_response = content;
+}
+
+int ESP8266WebServer::request(HTTPMethod method, const char *uri, const String &body, String &response) {
+	for (handler &h: _handlers)
+		if (h.uri == uri && (h.method == HTTP_ANY || h.method == method)) {
+			_body = body;
+			_response = &response;
+			_code = 500;
+			h.fn();
+			_response = 0;
+			_body = String();
+			return _code;
+		}
+	return 404;
+}
+
+int web_request(int method, const char *uri, const String &body, String &response) {
+	return instance? instance->request((HTTPMethod)method, uri, body, response): 404;
+}
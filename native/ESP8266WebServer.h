@@ -0,0 +1,42 @@
+#pragma once
+
+// a web server whose requests come from web_request() rather than the network
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <functional>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+class ESP8266WebServer {
+public:
+	typedef std::function<void(void)> THandlerFunction;
+
+	ESP8266WebServer(int port = 80);
+
+	void on(const String &uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+	void on(const String &uri, HTTPMethod method, THandlerFunction fn) { _handlers.push_back({ uri, method, fn }); }
+	void on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction upload) { on(uri, method, fn); }
+	void serveStatic(const char *uri, FS &fs, const char *path, const char *cache_header = 0) {}
+	void begin() {}
+	void handleClient() {}
+
+	bool hasArg(const String &name) const { return name == "plain" && _body.length(); }
+	String arg(const String &name) const { return name == "plain"? _body: String(); }
+	void send(int code, const char *type = "text/plain", const String &content = String());
+	void send(int code, const String &type, const String &content) { send(code, type.c_str(), content); }
+
+	// the response's status and body, 404 if nothing handles it
+	int request(HTTPMethod method, const char *uri, const String &body, String &response);
+
+private:
+	struct handler {
+		String uri;
+		HTTPMethod method;
+		THandlerFunction fn;
+	};
+	std::vector<handler> _handlers;
+	String _body, *_response = 0;
+	int _code;
+};
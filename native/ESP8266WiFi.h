@@ -0,0 +1,89 @@
+#pragma once
+
+// a station that's always associated, and clients over the host's sockets
+
+#include <Arduino.h>
+#include <lwip/dns.h>
+
+class IPAddress: public Printable {
+public:
+	IPAddress(): _addr(0) {}
+	IPAddress(uint32_t addr): _addr(addr) {}
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d):
+		_addr(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+	IPAddress(const ip_addr_t *addr): _addr(addr->addr) {}
+
+	operator uint32_t() const { return _addr; }
+	uint8_t operator[](int i) const { return _addr >> (8 * i); }
+	bool isSet() const { return _addr; }
+	String toString() const;
+	size_t printTo(Print &p) const { return p.print(toString()); }
+
+private:
+	uint32_t _addr;	// network byte order
+};
+
+#define WL_IDLE_STATUS		0
+#define WL_NO_SSID_AVAIL	1
+#define WL_CONNECTED		3
+#define WL_CONNECT_FAILED	4
+#define WL_DISCONNECTED		6
+
+enum WiFiMode_t { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA };
+enum WiFiSleepType_t { WIFI_NONE_SLEEP, WIFI_LIGHT_SLEEP, WIFI_MODEM_SLEEP };
+
+class WiFiClass {
+public:
+	bool mode(WiFiMode_t) { return true; }
+	bool hostname(const char *) { return true; }
+	bool setSleepMode(WiFiSleepType_t) { return true; }
+	bool setAutoConnect(bool) { return true; }
+	bool setAutoReconnect(bool) { return true; }
+	int begin(const char *ssid, const char *password = 0, int32_t channel = 0, const uint8_t *bssid = 0, bool connect = true) { return WL_CONNECTED; }
+	bool config(IPAddress ip, IPAddress gateway, IPAddress mask, IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress()) { return true; }
+	bool disconnect(bool off = false) { return true; }
+	bool softAP(const char *ssid) { return true; }
+	int status() { return WL_CONNECTED; }
+
+	uint8_t *BSSID() { static uint8_t bssid[6]; return bssid; }
+	int32_t channel() { return 1; }
+	IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+	IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+	IPAddress gatewayIP() { return IPAddress(127, 0, 0, 1); }
+	IPAddress subnetMask() { return IPAddress(255, 0, 0, 0); }
+	IPAddress dnsIP(int n = 0) { return IPAddress(127, 0, 0, 1); }
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient: public Stream {
+public:
+	WiFiClient() {}
+	~WiFiClient() { stop(); }
+	WiFiClient(const WiFiClient &) = delete;
+	WiFiClient &operator=(const WiFiClient &) = delete;
+
+	int connect(IPAddress ip, uint16_t port);
+	int connect(const char *host, uint16_t port);
+	uint8_t connected();
+	void stop();
+	operator bool() { return connected(); }
+	void setNoDelay(bool) {}
+
+	size_t write(uint8_t c) { return write(&c, 1); }
+	size_t write(const uint8_t *buf, size_t n);
+	using Print::write;
+	int available();
+	int read();
+	int read(uint8_t *buf, size_t n);
+	int peek();
+
+private:
+	int _fd = -1;
+	bool _replay = false, _closed = true;
+	std::string _request, _rx;
+	size_t _rx_pos = 0;
+
+	void receive();
+	void respond();
+};
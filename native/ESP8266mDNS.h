@@ -0,0 +1,12 @@
+#pragma once
+
+// mDNS, which announces nothing
+
+#include <ESP8266WiFi.h>
+
+class MDNSResponder {
+public:
+	bool begin(const char *hostname, const IPAddress &ip = IPAddress()) { return true; }
+	bool update() { return true; }
+	bool addService(const char *service, const char *proto, uint16_t port) { return true; }
+};
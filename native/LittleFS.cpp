@@ -0,0 +1,190 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "native.h"
+
+// reads are buffered, as LittleFS caches a block
+#define FILE_BUFFER	256
+
+FS LittleFS;
+
+static std::string root = ".";
+
+void fs_mount(const char *dir) {
+	root = dir;
+}
+
+bool fs_copy(const char *from, char *to) {
+	DIR *d = opendir(from);
+	if (!d || !mkdtemp(to))
+		return false;
+	for (struct dirent *e; (e = readdir(d)); ) {
+		String src = String(from) + "/" + e->d_name, dst = String(to) + "/" + e->d_name;
+		struct stat st;
+		if (stat(src.c_str(), &st) || !S_ISREG(st.st_mode))
+			continue;
+		FILE *in = fopen(src.c_str(), "rb"), *out = fopen(dst.c_str(), "wb");
+		char buf[4096];
+		for (size_t n; in && out && (n = fread(buf, 1, sizeof(buf), in)) > 0; )
+			fwrite(buf, 1, n, out);
+		if (in)
+			fclose(in);
+		if (out)
+			fclose(out);
+	}
+	closedir(d);
+	return true;
+}
+
+void fs_remove(const char *dir) {
+	DIR *d = opendir(dir);
+	if (!d)
+		return;
+	for (struct dirent *e; (e = readdir(d)); )
+		if (*e->d_name != '.')
+			unlink((String(dir) + "/" + e->d_name).c_str());
+	closedir(d);
+	rmdir(dir);
+}
+
+static std::string host_path(const char *path) {
+	return root + (*path == '/'? "": "/") + path;
+}
+
+struct File::file {
+	int fd;
+	std::string name;
+	uint32_t pos, size;
+	uint8_t buf[FILE_BUFFER];
+	uint32_t buf_pos, buf_len;	// buf holds [buf_pos, buf_pos + buf_len)
+
+	~file() { ::close(fd); }
+};
+
+const char *File::name() const {
+	return _f? _f->name.c_str(): "";
+}
+
+size_t File::size() const {
+	return _f? _f->size: 0;
+}
+
+size_t File::position() const {
+	return _f? _f->pos: 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+	if (!_f)
+		return false;
+	if (mode == SeekCur)
+		pos += _f->pos;
+	else if (mode == SeekEnd)
+		pos = _f->size - pos;
+	if (pos > _f->size)
+		return false;
+	_f->pos = pos;
+	return true;
+}
+
+size_t File::write(const uint8_t *buf, size_t n) {
+	if (!_f)
+		return 0;
+	ssize_t w = pwrite(_f->fd, buf, n, _f->pos);
+	if (w <= 0)
+		return 0;
+	_f->buf_len = 0;
+	_f->pos += w;
+	if (_f->pos > _f->size)
+		_f->size = _f->pos;
+	return w;
+}
+
+int File::available() {
+	return _f? _f->size - _f->pos: 0;
+}
+
+size_t File::read(uint8_t *buf, size_t n) {
+	if (!_f)
+		return 0;
+	file &f = *_f;
+	size_t r = 0;
+	while (r < n && f.pos < f.size) {
+		if (f.pos < f.buf_pos || f.pos >= f.buf_pos + f.buf_len) {
+			ssize_t got = pread(f.fd, f.buf, sizeof(f.buf), f.pos);
+			if (got <= 0)
+				break;
+			f.buf_pos = f.pos;
+			f.buf_len = got;
+		}
+		size_t k = min((size_t)(f.buf_pos + f.buf_len - f.pos), n - r);
+		memcpy(buf + r, f.buf + (f.pos - f.buf_pos), k);
+		f.pos += k;
+		r += k;
+	}
+	return r;
+}
+
+int File::read() {
+	uint8_t c;
+	return read(&c, 1) == 1? c: -1;
+}
+
+int File::peek() {
+	int c = read();
+	if (c >= 0)
+		_f->pos--;
+	return c;
+}
+
+bool FS::begin() {
+	struct stat st;
+	return !stat(root.c_str(), &st) && S_ISDIR(st.st_mode);
+}
+
+File FS::open(const char *path, const char *mode) {
+	int flags = O_RDONLY;
+	if (*mode == 'w')
+		flags = O_RDWR | O_CREAT | O_TRUNC;
+	else if (*mode == 'a')
+		flags = O_RDWR | O_CREAT | O_APPEND;
+	else if (mode[1] == '+')
+		flags = O_RDWR;
+
+	File f;
+	std::string name = host_path(path);
+	int fd = ::open(name.c_str(), flags, 0644);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+		if (fd >= 0)
+			::close(fd);
+		return f;
+	}
+
+	f._f = std::make_shared<File::file>();
+	f._f->fd = fd;
+	f._f->name = path;
+	f._f->size = st.st_size;
+	f._f->pos = *mode == 'a'? st.st_size: 0;
+	f._f->buf_pos = f._f->buf_len = 0;
+	return f;
+}
+
+bool FS::exists(const char *path) {
+	return !access(host_path(path).c_str(), F_OK);
+}
+
+bool FS::remove(const char *path) {
+	return !unlink(host_path(path).c_str());
+}
+
+bool FS::rename(const char *from, const char *to) {
+	return !::rename(host_path(from).c_str(), host_path(to).c_str());
+}
+
+bool FS::mkdir(const char *path) {
+	return !::mkdir(host_path(path).c_str(), 0755);
+}
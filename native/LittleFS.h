@@ -0,0 +1,49 @@
+#pragma once
+
+// a filesystem in a directory, mounted with fs_mount()
+
+#include <Arduino.h>
+#include <memory>
+
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+class File: public Stream {
+public:
+	File() {}
+
+	operator bool() const { return (bool)_f; }
+	const char *name() const;
+	size_t size() const;
+	size_t position() const;
+	bool seek(uint32_t pos, SeekMode mode = SeekSet);
+	void close() { _f.reset(); }
+
+	size_t write(uint8_t c) { return write(&c, 1); }
+	size_t write(const uint8_t *buf, size_t n);
+	using Print::write;
+	int available();
+	int read();
+	size_t read(uint8_t *buf, size_t n);
+	int peek();
+	void flush() {}
+
+private:
+	struct file;
+	std::shared_ptr<file> _f;
+
+	friend class FS;
+};
+
+class FS {
+public:
+	bool begin();
+	void end() {}
+	File open(const char *path, const char *mode);
+	File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+	bool exists(const char *path);
+	bool remove(const char *path);
+	bool rename(const char *from, const char *to);
+	bool mkdir(const char *path);
+};
+
+extern FS LittleFS;
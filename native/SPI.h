@@ -0,0 +1,3 @@
+#pragma once
+
+// the display's stand-in doesn't need SPI
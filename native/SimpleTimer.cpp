@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include <SimpleTimer.h>
+
+#include "native.h"
+
+#define INSTANCES	4
+
+static SimpleTimer *instances[INSTANCES];
+
+unsigned long timers_full, timers_clobbered;
+
+SimpleTimer::SimpleTimer() {
+	memset(_callbacks, 0, sizeof(_callbacks));
+	memset(_enabled, 0, sizeof(_enabled));
+	memset(_call, 0, sizeof(_call));
+	memset(_set, 0, sizeof(_set));
+	for (int i = 0; i < INSTANCES; i++)
+		if (!instances[i]) {
+			instances[i] = this;
+			break;
+		}
+}
+
+// timers fire when their delay has passed since they last did, so they don't drift
+void SimpleTimer::run() {
+	uint32_t now = millis();
+	for (int i = 0; i < MAX_TIMERS; i++) {
+		_call[i] = DONTRUN;
+		if (!_callbacks[i] || now - _prev[i] < (uint32_t)_delays[i])
+			continue;
+		_prev[i] += _delays[i];
+		if (!_enabled[i])
+			continue;
+		if (_max_runs[i] == RUN_FOREVER)
+			_call[i] = RUNONLY;
+		else if (_runs[i] < _max_runs[i]) {
+			_call[i] = RUNONLY;
+			if (++_runs[i] >= _max_runs[i])
+				_call[i] = RUNANDDEL;
+		}
+	}
+
+	for (int i = 0; i < MAX_TIMERS; i++)
+		switch (_call[i]) {
+		case RUNONLY:
+			_callbacks[i]();
+			break;
+		case RUNANDDEL: {
+			// the slot's deleted whatever the callback did with it
+			unsigned set = _set[i];
+			_callbacks[i]();
+			if (_set[i] != set)
+				timers_clobbered++;
+			deleteTimer(i);
+			break;
+		}
+		}
+}
+
+int SimpleTimer::setTimer(long d, timer_callback f, int n) {
+	if (_num >= MAX_TIMERS) {
+		timers_full++;
+		return -1;
+	}
+	int i = 0;
+	while (_callbacks[i])
+		i++;
+	if (!f)
+		return -1;
+
+	_delays[i] = d;
+	_callbacks[i] = f;
+	_max_runs[i] = n;
+	_runs[i] = 0;
+	_enabled[i] = true;
+	_prev[i] = millis();
+	_set[i]++;
+	_num++;
+	return i;
+}
+
+void SimpleTimer::deleteTimer(int id) {
+	if (id < 0 || id >= MAX_TIMERS || !_num || !_callbacks[id])
+		return;
+	_callbacks[id] = 0;
+	_enabled[id] = false;
+	_call[id] = DONTRUN;
+	_delays[id] = 0;
+	_runs[id] = 0;
+	_num--;
+}
+
+void SimpleTimer::restartTimer(int id) {
+	if (id >= 0 && id < MAX_TIMERS)
+		_prev[id] = millis();
+}
+
+void SimpleTimer::enable(int id) {
+	if (id >= 0 && id < MAX_TIMERS)
+		_enabled[id] = true;
+}
+
+void SimpleTimer::disable(int id) {
+	if (id >= 0 && id < MAX_TIMERS)
+		_enabled[id] = false;
+}
+
+void SimpleTimer::toggle(int id) {
+	if (id >= 0 && id < MAX_TIMERS)
+		_enabled[id] = !_enabled[id];
+}
+
+uint32_t SimpleTimer::due(uint32_t max) {
+	uint32_t now = millis();
+	for (int i = 0; i < MAX_TIMERS; i++)
+		if (_callbacks[i] && _enabled[i]) {
+			uint32_t since = now - _prev[i];
+			uint32_t left = since >= (uint32_t)_delays[i]? 0: _delays[i] - since;
+			if (left < max)
+				max = left;
+		}
+	return max;
+}
+
+uint32_t timers_due(uint32_t max) {
+	for (int i = 0; i < INSTANCES; i++)
+		if (instances[i])
+			max = instances[i]->due(max);
+	return max;
+}
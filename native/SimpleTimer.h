@@ -0,0 +1,49 @@
+#pragma once
+
+// a model of what the sketch relies on from the SimpleTimer library,
+// rather than the library itself: MAX_TIMERS slots, timers which fire when
+// their delay has passed since they last did, and one-off timers' slots
+// deleted after their callbacks run. It hasn't been compared with the
+// library's sources, so whatever else they do isn't modelled. Every
+// instance is known to timers_due()
+
+#include <Arduino.h>
+
+typedef void (*timer_callback)(void);
+
+class SimpleTimer {
+public:
+	const static int MAX_TIMERS = 10;
+	const static int RUN_FOREVER = 0;
+	const static int RUN_ONCE = 1;
+
+	SimpleTimer();
+
+	void run();
+	int setInterval(long d, timer_callback f) { return setTimer(d, f, RUN_FOREVER); }
+	int setTimeout(long d, timer_callback f) { return setTimer(d, f, RUN_ONCE); }
+	int setTimer(long d, timer_callback f, int n);
+	void deleteTimer(int id);
+	void restartTimer(int id);
+	boolean isEnabled(int id) { return id >= 0 && id < MAX_TIMERS && _enabled[id]; }
+	void enable(int id);
+	void disable(int id);
+	void toggle(int id);
+	int getNumTimers() { return _num; }
+	int getNumAvailableTimers() { return MAX_TIMERS - _num; }
+
+	// ms until the next is due, at most max
+	uint32_t due(uint32_t max);
+
+private:
+	enum { DONTRUN, RUNONLY, RUNANDDEL };
+
+	timer_callback _callbacks[MAX_TIMERS];
+	uint32_t _prev[MAX_TIMERS];
+	long _delays[MAX_TIMERS];
+	int _max_runs[MAX_TIMERS], _runs[MAX_TIMERS];
+	bool _enabled[MAX_TIMERS];
+	uint8_t _call[MAX_TIMERS];
+	unsigned _set[MAX_TIMERS];	// times each slot has been set
+	int _num = 0;
+};
@@ -0,0 +1,228 @@
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#include "native.h"
+
+TFT_eSPI::TFT_eSPI(int16_t w, int16_t h): _w(w), _h(h) {
+	resetViewport();
+}
+
+TFT_eSPI::~TFT_eSPI() {
+	if (_fb)
+		untracked_free(_fb);
+}
+
+// the display's memory is its own, not the ESP8266's
+uint16_t *TFT_eSPI::allocate(size_t pixels) {
+	return (uint16_t *)untracked_alloc(pixels * sizeof(uint16_t));
+}
+
+void TFT_eSPI::release(uint16_t *fb) {
+	untracked_free(fb);
+}
+
+bool TFT_eSPI::resize(int16_t w, int16_t h) {
+	if (_fb)
+		release(_fb);
+	_fb = w > 0 && h > 0? allocate(w * h): 0;
+	_w = _fb? w: 0;
+	_h = _fb? h: 0;
+	resetViewport();
+	return _fb;
+}
+
+void TFT_eSPI::init() {
+	resize(_w, _h);
+}
+
+void TFT_eSPI::setRotation(uint8_t r) {
+	_rotation = r & 3;
+	int16_t w = _rotation & 1? TFT_HEIGHT: TFT_WIDTH;
+	int16_t h = _rotation & 1? TFT_WIDTH: TFT_HEIGHT;
+	if (w != _w || h != _h)
+		resize(w, h);
+}
+
+void TFT_eSPI::setViewport(int32_t x, int32_t y, int32_t w, int32_t h, bool datum) {
+	_xo = datum? x: 0;
+	_yo = datum? y: 0;
+	_vp_w = w;
+	_vp_h = h;
+	_x0 = max(x, (int32_t)0);
+	_y0 = max(y, (int32_t)0);
+	_x1 = min(x + w, _fb? (int32_t)_w: 0);
+	_y1 = min(y + h, _fb? (int32_t)_h: 0);
+}
+
+void TFT_eSPI::resetViewport() {
+	setViewport(0, 0, _w, _h);
+}
+
+void TFT_eSPI::pixel(int32_t x, int32_t y, uint16_t colour) {
+	x += _xo;
+	y += _yo;
+	if (x >= _x0 && x < _x1 && y >= _y0 && y < _y1)
+		_fb[y * _w + x] = colour;
+}
+
+void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t colour) {
+	pixel(x, y, colour);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t colour) {
+	int32_t xs = max(x + _xo, _x0), xe = min(x + _xo + w, _x1);
+	int32_t ys = max(y + _yo, _y0), ye = min(y + _yo + h, _y1);
+	for (int32_t j = ys; j < ye; j++)
+		for (int32_t i = xs; i < xe; i++)
+			_fb[j * _w + i] = colour;
+}
+
+void TFT_eSPI::fillScreen(uint32_t colour) {
+	fillRect(_x0 - _xo, _y0 - _yo, _x1 - _x0, _y1 - _y0, colour);
+}
+
+void TFT_eSPI::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t colour) {
+	drawFastHLine(x, y, w, colour);
+	drawFastHLine(x, y + h - 1, w, colour);
+	drawFastVLine(x, y, h, colour);
+	drawFastVLine(x + w - 1, y, h, colour);
+}
+
+void TFT_eSPI::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t colour) {
+	int32_t dx = abs(x1 - x0), sx = x0 < x1? 1: -1;
+	int32_t dy = -abs(y1 - y0), sy = y0 < y1? 1: -1;
+	for (int32_t err = dx + dy; ; ) {
+		pixel(x0, y0, colour);
+		if (x0 == x1 && y0 == y1)
+			break;
+		int32_t e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x0 += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y0 += sy;
+		}
+	}
+}
+
+void TFT_eSPI::drawCircle(int32_t x, int32_t y, int32_t r, uint32_t colour) {
+	for (int32_t i = -r; i <= r; i++)
+		for (int32_t j = -r; j <= r; j++) {
+			int32_t d = i * i + j * j;
+			if (d <= r * r && d > (r - 1) * (r - 1))
+				pixel(x + i, y + j, colour);
+		}
+}
+
+void TFT_eSPI::fillCircle(int32_t x, int32_t y, int32_t r, uint32_t colour) {
+	for (int32_t j = -r; j <= r; j++) {
+		int32_t w = sqrt(r * r - j * j);
+		fillRect(x - w, y + j, 2 * w + 1, 1, colour);
+	}
+}
+
+// colours are sent as they are if swapping, otherwise they're big-endian
+void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data) {
+	for (int32_t j = 0; j < h; j++)
+		for (int32_t i = 0; i < w; i++)
+			pixel(x + i, y + j, swapped(*data++));
+}
+
+void TFT_eSPI::blit(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *pixels) {
+	for (int32_t j = 0; j < h; j++)
+		for (int32_t i = 0; i < w; i++)
+			pixel(x + i, y + j, *pixels++);
+}
+
+void TFT_eSPI::setAddrWindow(int32_t x, int32_t y, int32_t w, int32_t h) {
+	_win_x = x;
+	_win_y = y;
+	_win_w = w;
+	_win_h = h;
+	_win_pos = 0;
+}
+
+void TFT_eSPI::pushPixels(const void *data, uint32_t n) {
+	const uint16_t *p = (const uint16_t *)data;
+	while (n-- && _win_w > 0 && _win_pos < _win_w * _win_h) {
+		pixel(_win_x + _win_pos % _win_w, _win_y + _win_pos / _win_w, swapped(*p++));
+		_win_pos++;
+	}
+}
+
+void TFT_eSPI::pushColor(uint16_t colour, uint32_t n) {
+	while (n-- && _win_w > 0 && _win_pos < _win_w * _win_h) {
+		pixel(_win_x + _win_pos % _win_w, _win_y + _win_pos / _win_w, colour);
+		_win_pos++;
+	}
+}
+
+// the GLCD font is 6x8, font 2 is 16 high and proportional, here 8 wide
+int16_t TFT_eSPI::charWidth() const {
+	return (_font == 2? 8: 6) * _size;
+}
+
+int16_t TFT_eSPI::fontHeight() const {
+	return (_font == 2? 16: 8) * _size;
+}
+
+int16_t TFT_eSPI::textWidth(const char *s) const {
+	return strlen(s) * charWidth();
+}
+
+size_t TFT_eSPI::write(uint8_t c) {
+	if (c == '\n') {
+		_cx = 0;
+		_cy += fontHeight();
+		return 1;
+	}
+	if (c == '\r')
+		return 1;
+
+	int16_t w = charWidth(), h = fontHeight();
+	if (_bg != _fg)
+		fillRect(_cx, _cy, w, h, _bg);
+	if (c != ' ')
+		fillRect(_cx + _size, _cy + _size, w - 2 * _size, h - 2 * _size, _fg);
+	_cx += w;
+	return 1;
+}
+
+void *TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames) {
+	deleteSprite();
+	return resize(w, h)? _fb: 0;
+}
+
+void TFT_eSprite::deleteSprite() {
+	resize(0, 0);
+}
+
+void TFT_eSprite::pushSprite(int32_t x, int32_t y) {
+	if (_fb)
+		_tft->blit(x, y, _w, _h, _fb);
+}
+
+uint16_t *TFT_eSprite::allocate(size_t pixels) {
+	return (uint16_t *)malloc(pixels * sizeof(uint16_t));
+}
+
+void TFT_eSprite::release(uint16_t *fb) {
+	free(fb);
+}
+
+bool tft_dump(const char *filename) {
+	extern TFT_eSPI tft;
+	FILE *f = fopen(filename, "wb");
+	if (!f)
+		return false;
+	fprintf(f, "P6\n%d %d\n255\n", tft.frame_width(), tft.frame_height());
+	const uint16_t *p = tft.frame();
+	for (int i = 0; p && i < tft.frame_width() * tft.frame_height(); i++) {
+		uint16_t c = p[i];
+		uint8_t rgb[] = { (uint8_t)((c >> 8) & 0xF8), (uint8_t)((c >> 3) & 0xFC), (uint8_t)(c << 3) };
+		fwrite(rgb, 1, sizeof(rgb), f);
+	}
+	return !fclose(f);
+}
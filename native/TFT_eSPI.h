@@ -0,0 +1,132 @@
+#pragma once
+
+// the display, and sprites, as in-memory framebuffers of RGB565 pixels;
+// text is drawn as a box per character, in the font's cell
+
+#include <Arduino.h>
+
+#if !defined(TFT_WIDTH)
+#define TFT_WIDTH	128
+#endif
+#if !defined(TFT_HEIGHT)
+#define TFT_HEIGHT	128
+#endif
+
+#define TFT_BLACK	0x0000
+#define TFT_NAVY	0x000F
+#define TFT_DARKGREEN	0x03E0
+#define TFT_MAROON	0x7800
+#define TFT_DARKGREY	0x7BEF
+#define TFT_LIGHTGREY	0xD69A
+#define TFT_BLUE	0x001F
+#define TFT_GREEN	0x07E0
+#define TFT_CYAN	0x07FF
+#define TFT_RED		0xF800
+#define TFT_MAGENTA	0xF81F
+#define TFT_YELLOW	0xFFE0
+#define TFT_ORANGE	0xFDA0
+#define TFT_WHITE	0xFFFF
+
+class TFT_eSPI: public Print {
+public:
+	TFT_eSPI(int16_t w = TFT_WIDTH, int16_t h = TFT_HEIGHT);
+	virtual ~TFT_eSPI();
+
+	void init();
+	void begin() { init(); }
+	void setRotation(uint8_t r);
+	uint8_t getRotation() const { return _rotation; }
+	int16_t width() const { return _vp_w; }
+	int16_t height() const { return _vp_h; }
+
+	static uint16_t color565(uint8_t r, uint8_t g, uint8_t b) {
+		return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+	}
+
+	void fillScreen(uint32_t colour);
+	void drawPixel(int32_t x, int32_t y, uint32_t colour);
+	void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t colour);
+	void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t colour);
+	void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t colour) { fillRect(x, y, w, 1, colour); }
+	void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t colour) { fillRect(x, y, 1, h, colour); }
+	void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t colour);
+	void drawCircle(int32_t x, int32_t y, int32_t r, uint32_t colour);
+	void fillCircle(int32_t x, int32_t y, int32_t r, uint32_t colour);
+
+	void setSwapBytes(bool swap) { _swap = swap; }
+	bool getSwapBytes() const { return _swap; }
+	void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data);
+	void startWrite() {}
+	void endWrite() {}
+	void setAddrWindow(int32_t x, int32_t y, int32_t w, int32_t h);
+	void pushPixels(const void *data, uint32_t n);
+	void pushColor(uint16_t colour, uint32_t n = 1);
+
+	void setCursor(int16_t x, int16_t y) { _cx = x; _cy = y; }
+	int16_t getCursorX() const { return _cx; }
+	int16_t getCursorY() const { return _cy; }
+	void setTextColor(uint16_t fg) { _fg = _bg = fg; }
+	void setTextColor(uint16_t fg, uint16_t bg, bool fill = false) { _fg = fg; _bg = bg; }
+	void setTextSize(uint8_t size) { _size = size? size: 1; }
+	void setTextFont(uint8_t font) { _font = font; }
+	void setTextWrap(bool) {}
+	int16_t fontHeight() const;
+	int16_t textWidth(const char *s) const;
+	int16_t textWidth(const String &s) const { return textWidth(s.c_str()); }
+
+	size_t write(uint8_t c);
+	using Print::write;
+
+	void setViewport(int32_t x, int32_t y, int32_t w, int32_t h, bool datum = true);
+	void resetViewport();
+
+	// what's been drawn, row by row
+	const uint16_t *frame() const { return _fb; }
+	int16_t frame_width() const { return _w; }
+	int16_t frame_height() const { return _h; }
+
+protected:
+	uint16_t *_fb = 0;
+	int16_t _w, _h;
+
+	// the framebuffer, when resized
+	virtual uint16_t *allocate(size_t pixels);
+	virtual void release(uint16_t *fb);
+	bool resize(int16_t w, int16_t h);
+
+private:
+	uint8_t _rotation = 0;
+	int32_t _xo = 0, _yo = 0, _vp_w, _vp_h;		// viewport, drawn relative to
+	int32_t _x0 = 0, _y0 = 0, _x1, _y1;		// and clipped to
+	int32_t _win_x, _win_y, _win_w = 0, _win_h, _win_pos;
+	int16_t _cx = 0, _cy = 0;
+	uint16_t _fg = TFT_WHITE, _bg = TFT_WHITE;
+	uint8_t _size = 1, _font = 1;
+	bool _swap = false;
+
+	int16_t charWidth() const;
+	void pixel(int32_t x, int32_t y, uint16_t colour);
+	uint16_t swapped(uint16_t c) const { return _swap? c: (c >> 8) | (c << 8); }
+	void blit(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *pixels);
+
+	friend class TFT_eSprite;
+};
+
+class TFT_eSprite: public TFT_eSPI {
+public:
+	TFT_eSprite(TFT_eSPI *tft): TFT_eSPI(0, 0), _tft(tft) {}
+	~TFT_eSprite() { deleteSprite(); }
+
+	// the sprite's pixels are on the heap, as on the device
+	void *createSprite(int16_t w, int16_t h, uint8_t frames = 1);
+	bool created() const { return _fb; }
+	void deleteSprite();
+	void pushSprite(int32_t x, int32_t y);
+
+protected:
+	uint16_t *allocate(size_t pixels);
+	void release(uint16_t *fb);
+
+private:
+	TFT_eSPI *_tft;
+};
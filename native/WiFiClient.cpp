@@ -0,0 +1,261 @@
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <lwip/dns.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "native.h"
+
+#define CONNECT_TIMEOUT	5000
+
+WiFiClass WiFi;
+
+static std::string replay_dir;
+static long replay_shift;
+
+void wifi_replay(const char *dir) {
+	replay_dir = dir? dir: "";
+}
+
+void wifi_replay_shift(long seconds) {
+	replay_shift = seconds;
+}
+
+// moves on what look like timestamps: whole numbers of ten digits
+static void shift_times(std::string &body) {
+	for (size_t i = 0; i < body.size(); ) {
+		if (!isdigit(body[i])) {
+			i++;
+			continue;
+		}
+		size_t j = i;
+		while (j < body.size() && isdigit(body[j]))
+			j++;
+		bool fraction = i > 0 && body[i - 1] == '.', decimal = j < body.size() && body[j] == '.';
+		if (j - i == 10 && !fraction && !decimal) {
+			std::string t = std::to_string(std::stoll(body.substr(i, 10)) + replay_shift);
+			body.replace(i, 10, t);
+			j = i + t.size();
+		}
+		i = j;
+	}
+}
+
+String IPAddress::toString() const {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+	return String(buf);
+}
+
+err_t dns_gethostbyname(const char *name, ip_addr_t *addr, dns_found_callback found, void *arg) {
+
+	if (!replay_dir.empty()) {
+		addr->addr = htonl(INADDR_LOOPBACK);
+		return ERR_OK;
+	}
+
+	struct addrinfo hints = {}, *res;
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(name, 0, &hints, &res))
+		return ERR_ARG;
+	addr->addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+	freeaddrinfo(res);
+	return ERR_OK;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+	ip_addr_t addr;
+	if (dns_gethostbyname(host, &addr, 0, 0) != ERR_OK)
+		return 0;
+	return connect(IPAddress(&addr), port);
+}
+
+// blocks until connected, like the ESP8266's
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+
+	stop();
+	_rx.clear();
+	_rx_pos = 0;
+	_request.clear();
+	_closed = false;
+	_replay = !replay_dir.empty();
+	if (_replay)
+		return 1;
+
+	_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (_fd < 0)
+		return 0;
+	int one = 1;
+	setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	struct sockaddr_in sa = {};
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = (uint32_t)ip;
+	if (::connect(_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 && errno != EINPROGRESS) {
+		stop();
+		return 0;
+	}
+
+	struct pollfd p = { _fd, POLLOUT, 0 };
+	int err = 0;
+	socklen_t len = sizeof(err);
+	if (poll(&p, 1, CONNECT_TIMEOUT) != 1 || getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len) || err) {
+		stop();
+		return 0;
+	}
+	return 1;
+}
+
+void WiFiClient::stop() {
+	if (_fd >= 0)
+		close(_fd);
+	_fd = -1;
+	_replay = false;
+	_closed = true;
+	// unread data goes with it, as on the ESP8266
+	_rx.clear();
+	_rx_pos = 0;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t n) {
+
+	if (_closed)
+		return 0;
+	if (_replay) {
+		_request.append((const char *)buf, n);
+		respond();
+		return n;
+	}
+
+	size_t sent = 0;
+	while (sent < n) {
+		ssize_t w = send(_fd, buf + sent, n - sent, MSG_NOSIGNAL);
+		if (w < 0 && errno == EAGAIN) {
+			struct pollfd p = { _fd, POLLOUT, 0 };
+			poll(&p, 1, CONNECT_TIMEOUT);
+			continue;
+		}
+		if (w <= 0) {
+			_closed = true;
+			break;
+		}
+		sent += w;
+	}
+	return sent;
+}
+
+// whatever has arrived, without waiting
+void WiFiClient::receive() {
+
+	if (_rx_pos == _rx.size()) {
+		_rx.clear();
+		_rx_pos = 0;
+	}
+	if (_replay || _closed)
+		return;
+
+	char buf[1460];
+	for (;;) {
+		ssize_t r = recv(_fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (r > 0)
+			_rx.append(buf, r);
+		else {
+			if (r == 0 || errno != EAGAIN)
+				_closed = true;
+			break;
+		}
+	}
+}
+
+int WiFiClient::available() {
+	receive();
+	return _rx.size() - _rx_pos;
+}
+
+int WiFiClient::read() {
+	if (!available())
+		return -1;
+	return (uint8_t)_rx[_rx_pos++];
+}
+
+int WiFiClient::read(uint8_t *buf, size_t n) {
+	size_t a = available();
+	if (n > a)
+		n = a;
+	memcpy(buf, _rx.data() + _rx_pos, n);
+	_rx_pos += n;
+	return n;
+}
+
+int WiFiClient::peek() {
+	if (!available())
+		return -1;
+	return (uint8_t)_rx[_rx_pos];
+}
+
+// true while there's something left to read
+uint8_t WiFiClient::connected() {
+	return available() || (!_closed && (_replay || _fd >= 0));
+}
+
+static std::string http_date() {
+	char buf[40];
+	time_t now = time(0);
+	strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&now));
+	return buf;
+}
+
+// files holding a whole response, starting with its status line, are
+// sent as they are; anything else is sent as a JSON body
+static std::string replay_response(const std::string &host, const std::string &path) {
+
+	std::string name = replay_dir + "/" + host + path.substr(0, path.find('?'));
+	FILE *f = fopen(name.c_str(), "r");
+	if (!f) {
+		fprintf(stderr, "No response recorded in %s\n", name.c_str());
+		return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+	}
+
+	std::string body;
+	char buf[4096];
+	for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0; )
+		body.append(buf, n);
+	fclose(f);
+	if (replay_shift)
+		shift_times(body);
+	if (!body.compare(0, 7, "HTTP/1."))
+		return body;
+
+	return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: "
+		+ std::to_string(body.size()) + "\r\nDate: " + http_date() + "\r\n\r\n" + body;
+}
+
+// answers each whole request that's been written
+void WiFiClient::respond() {
+
+	size_t end;
+	while ((end = _request.find("\r\n\r\n")) != std::string::npos) {
+		std::string request = _request.substr(0, end + 2);
+		_request.erase(0, end + 4);
+
+		std::string path, host;
+		size_t sp = request.find(' ');
+		if (sp != std::string::npos)
+			path = request.substr(sp + 1, request.find(' ', sp + 1) - sp - 1);
+		size_t h = request.find("\r\nHost: ");
+		if (h != std::string::npos) {
+			h += 8;
+			host = request.substr(h, request.find("\r\n", h) - h);
+		}
+		_rx += replay_response(host, path);
+	}
+}
@@ -0,0 +1,282 @@
+// times parsing the synthetic responses in each size of the corpus, painting
+// each screen and whole update cycles, printing the results as JSON
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <ESP8266WiFi.h>
+#include <TFT_eSPI.h>
+#include <TimeLib.h>
+#include <Timezone.h>
+#include <unistd.h>
+
+#include "Configuration.h"
+#include "state.h"
+#include "display.h"
+#include "dbg.h"
+#include "providers.h"
+#include "native.h"
+
+#if !defined(PROVIDER)
+#define PROVIDER OpenWeatherMap
+#endif
+
+TFT_eSPI tft;
+bool debug;
+
+config cfg;
+Timezone *tz;
+struct Conditions conditions;
+struct Forecast forecasts[4];
+struct Statistics stats;
+
+PROVIDER provider;
+
+static const int days = sizeof(forecasts)/sizeof(forecasts[0]);
+
+static OpenMeteo openmeteo;
+static OpenWeatherMap owm;
+
+static const char *sizes[] = { "small", "medium", "large" };
+
+// what each response is parsed by
+static const struct parser {
+	const char *name;
+	Provider *provider;
+	uint8_t what;
+	bool nearest;
+} parsers[] = {
+	{ "openmeteo", &openmeteo, FETCH_CONDITIONS | FETCH_FORECASTS, false },
+	{ "owm-conditions", &owm, FETCH_CONDITIONS, false },
+	{ "owm-forecasts", &owm, FETCH_FORECASTS, false },
+	{ "geocoding", &openmeteo, FETCH_LOCATION, false },
+	{ "ip-api", &openmeteo, FETCH_LOCATION, true },
+};
+
+static const struct parser *parsing;
+
+static uint8_t fetch(Provider &p, uint8_t what) {
+	if (!p.fetch(what))
+		return FETCH_FAILED;
+	uint8_t updated;
+	while ((updated = p.poll(conditions, forecasts, days)) & FETCH_PENDING)
+		yield();
+	return updated;
+}
+
+static bool parse() {
+	cfg.nearest = parsing->nearest;
+	conditions.epoch = 0;
+	return !(fetch(*parsing->provider, parsing->what) & FETCH_FAILED);
+}
+
+static bool update() {
+	conditions.epoch = 0;
+	uint8_t updated;
+	if (provider.combines())
+		updated = fetch(provider, FETCH_CONDITIONS | FETCH_FORECASTS);
+	else
+		updated = fetch(provider, FETCH_CONDITIONS) | fetch(provider, FETCH_FORECASTS);
+	return !(updated & FETCH_FAILED);
+}
+
+static int screen;
+
+static bool paint() {
+	switch (screen) {
+	case 0:
+		display_weather(conditions);
+		break;
+	case 1:
+		display_astronomy(conditions);
+		break;
+	case 6:
+		display_about(stats);
+		break;
+	default:
+		display_forecast(forecasts[screen - 2]);
+		break;
+	}
+	return true;
+}
+
+static const char *screens[] = { "weather", "astronomy", "forecast-0", "forecast-1", "forecast-2", "forecast-3", "about" };
+
+// the forecasts in turn, each with a different icon, so more miss the cache
+static bool icons() {
+	static int f;
+	display_forecast(forecasts[f++ % days]);
+	return true;
+}
+
+// everything update_display() does after a fetch
+static bool cycle() {
+	if (!update())
+		return false;
+	for (screen = 0; screen < 7; screen++)
+		paint();
+	return true;
+}
+
+static int runs = 100;
+static const char *only;
+static uint32_t *samples;
+static JsonArray results;
+
+static int cmp(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y? -1: x > y;
+}
+
+// nearest-rank
+static uint32_t percentile(int p) {
+	int i = (p * runs + 99) / 100;
+	return samples[i > 0? i - 1: 0];
+}
+
+// the first run is reported on its own, as it fills the caches and pool
+static void bench(const String &name, bool (*run)(), bool fetches) {
+	if (only && !strstr(name.c_str(), only))
+		return;
+
+	uint32_t start = micros();
+	bool ok = run();
+	uint32_t cold_us = micros() - start;
+
+	int failed = !ok;
+	size_t peak = 0;
+	unsigned long allocs = 0;
+	uint32_t doc_heap = 0;
+	uint64_t total_us = 0;
+	for (int i = 0; i < runs; i++) {
+		size_t used = heap.used;
+		unsigned long a = heap.allocs;
+		heap_reset_peak();
+		stats.heap_conditions = stats.heap_forecasts = 0;
+
+		start = micros();
+		if (!run())
+			failed++;
+		samples[i] = micros() - start;
+
+		total_us += samples[i];
+		allocs += heap.allocs - a;
+		if (heap.peak - used > peak)
+			peak = heap.peak - used;
+		doc_heap = max(doc_heap, max(stats.heap_conditions, stats.heap_forecasts));
+	}
+	qsort(samples, runs, sizeof(samples[0]), cmp);
+
+	JsonObject r = results.add<JsonObject>();
+	r[F("name")] = name;
+	r[F("runs")] = runs;
+	r[F("failed")] = failed;
+	r[F("cold_us")] = cold_us;
+	r[F("mean_us")] = total_us / max(runs, 1);
+	r[F("p50_us")] = percentile(50);
+	r[F("p90_us")] = percentile(90);
+	r[F("p99_us")] = percentile(99);
+	r[F("max_us")] = samples[runs - 1];
+	r[F("per_s")] = total_us? 1e6 * runs / total_us: 0;
+	if (fetches) {
+		r[F("bytes")] = stats.rx_bytes;
+		r[F("kb_per_s")] = total_us? 1e6 * runs * stats.rx_bytes / total_us / 1024: 0;
+		r[F("doc_heap")] = doc_heap;
+	}
+	r[F("allocs")] = allocs / max(runs, 1);
+	r[F("heap_peak")] = peak;
+	fprintf(stderr, "%-28s p50 %8u us  p99 %8u us%s\n", name.c_str(), percentile(50), percentile(99), failed? "  FAILED": "");
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [-d] [-f fs-dir] [-c corpus-dir] [-n runs] [-s scenario]\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	const char *fs = "data", *corpus = "native/bench";
+
+	for (int opt; (opt = getopt(argc, argv, "df:c:n:s:")) != -1; )
+		switch (opt) {
+		case 'd':
+			debug = true;
+			break;
+		case 'f':
+			fs = optarg;
+			break;
+		case 'c':
+			corpus = optarg;
+			break;
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		case 's':
+			only = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	if (runs < 1)
+		usage(argv[0]);
+
+	fs_mount(fs);
+	if (!LittleFS.begin() || !cfg.read_file("/config.json")) {
+		fprintf(stderr, "No /config.json in %s\n", fs);
+		return 1;
+	}
+	if (!*cfg.station)
+		strlcpy(cfg.station, "Dublin", sizeof(cfg.station));
+
+	tz = new Timezone(cfg.summer, cfg.winter);
+	tft.init();
+	tft.setRotation(cfg.rotate);
+	tft.fillScreen(TFT_BLACK);
+#if defined(FONT)
+	tft.setTextFont(FONT);
+#endif
+
+	samples = (uint32_t *)untracked_alloc(runs * sizeof(uint32_t));
+	JsonDocument doc;
+	doc[F("runs")] = runs;
+	doc[F("heap")] = NATIVE_HEAP;
+	results = doc[F("scenarios")].to<JsonArray>();
+
+	String dir;
+	bool nearest = cfg.nearest;
+	for (const char *size: sizes) {
+		dir = String(corpus) + "/" + size;
+		wifi_replay(dir.c_str());
+		for (const struct parser &p: parsers) {
+			parsing = &p;
+			bench(String(F("parse/")) + p.name + "/" + size, parse, true);
+		}
+	}
+
+	// the screens show what the medium responses hold
+	dir = String(corpus) + "/medium";
+	wifi_replay(dir.c_str());
+	cfg.nearest = nearest;
+	if (!update()) {
+		fprintf(stderr, "Failed to fetch from %s\n", dir.c_str());
+		return 1;
+	}
+	for (screen = 0; screen < 7; screen++)
+		bench(String(F("paint/")) + screens[screen], paint, false);
+	bench(F("paint/icons"), icons, false);
+	bench(F("cycle"), cycle, true);
+	untracked_free(samples);
+
+	JsonObject s = doc[F("stats")].to<JsonObject>();
+	s[F("http_requests")] = stats.http_requests;
+	s[F("http_connects")] = stats.http_connects;
+	s[F("parse_failures")] = stats.parse_failures;
+	s[F("mem_failures")] = stats.mem_failures;
+	s[F("icon_hits")] = stats.icon_hits;
+	s[F("icon_misses")] = stats.icon_misses;
+	s[F("icon_evictions")] = stats.icon_evictions;
+	s[F("icon_hit_rate")] = stats.icon_hit_rate();
+
+	String out;
+	serializeJsonPretty(doc, out);
+	puts(out.c_str());
+	return 0;
+}
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+#include "native.h"
+
+// linked with --wrap for each of these, so every allocation, including
+// ArduinoJson's and operator new's, is counted
+extern "C" {
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void __real_free(void *p);
+}
+
+struct heap_stats heap;
+
+// where each allocation would be in the ESP8266's heap, for its largest
+// free block: umm_malloc places them best-fit, in 8-byte blocks including
+// a 4-byte header
+#define HEAP_BLOCK	8
+#define HEAP_HEADER	4
+#define HEAP_LIVE	4096
+
+static struct placed {
+	void *p;
+	uint32_t offset, size;
+} placed[HEAP_LIVE];	// by offset
+static int nplaced;
+
+static uint32_t blocks(size_t n) {
+	return (n + HEAP_HEADER + HEAP_BLOCK - 1) / HEAP_BLOCK * HEAP_BLOCK;
+}
+
+static uint32_t end_of(int i) {
+	return i > 0? placed[i - 1].offset + placed[i - 1].size: 0;
+}
+
+// those which don't fit go past the end, and are counted
+static void place(void *p, size_t n) {
+	if (nplaced == HEAP_LIVE)
+		return;
+	uint32_t size = blocks(n), best_gap = UINT32_MAX;
+	int best = -1;
+	for (int i = 0; i <= nplaced; i++) {
+		uint32_t start = end_of(i), next = i < nplaced? placed[i].offset: NATIVE_HEAP;
+		if (next >= start + size && next - start < best_gap) {
+			best = i;
+			best_gap = next - start;
+		}
+	}
+	uint32_t offset;
+	if (best < 0) {
+		heap.overflows++;
+		best = nplaced;
+		offset = std::max(end_of(nplaced), (uint32_t)NATIVE_HEAP);
+	} else
+		offset = end_of(best);
+
+	memmove(placed + best + 1, placed + best, (nplaced - best) * sizeof(placed[0]));
+	placed[best] = { p, offset, size };
+	nplaced++;
+	if (offset < NATIVE_HEAP)
+		heap.placed += size;
+}
+
+static int find(void *p) {
+	for (int i = nplaced; i-- > 0; )
+		if (placed[i].p == p)
+			return i;
+	return -1;
+}
+
+static void unplace(int i) {
+	if (placed[i].offset < NATIVE_HEAP)
+		heap.placed -= placed[i].size;
+	nplaced--;
+	memmove(placed + i, placed + i + 1, (nplaced - i) * sizeof(placed[0]));
+}
+
+// in place if it's shrinking or what follows is free
+static void replace(void *p, void *q, size_t n) {
+	int i = find(p);
+	if (i < 0) {
+		place(q, n);
+		return;
+	}
+	uint32_t size = blocks(n), next = i + 1 < nplaced? placed[i + 1].offset: NATIVE_HEAP;
+	if (size <= placed[i].size || placed[i].offset + size <= next) {
+		if (placed[i].offset < NATIVE_HEAP)
+			heap.placed += size - placed[i].size;
+		placed[i].p = q;
+		placed[i].size = size;
+		return;
+	}
+	unplace(i);
+	place(q, n);
+}
+
+size_t heap_free() {
+	return heap.placed < NATIVE_HEAP? NATIVE_HEAP - heap.placed: 0;
+}
+
+size_t heap_max_block() {
+	uint32_t max_gap = 0;
+	for (int i = 0; i <= nplaced; i++) {
+		uint32_t start = end_of(i), next = i < nplaced? placed[i].offset: NATIVE_HEAP;
+		if (next > start && next - start > max_gap)
+			max_gap = next - start;
+	}
+	return max_gap > HEAP_HEADER? max_gap - HEAP_HEADER: 0;
+}
+
+static void allocated(void *p, size_t n) {
+	if (!p)
+		return;
+	place(p, n);
+	heap.used += malloc_usable_size(p);
+	heap.allocs++;
+	if (heap.used > heap.peak)
+		heap.peak = heap.used;
+}
+
+// anything libc allocated itself is freed without having been counted
+static void freed(void *p) {
+	if (!p)
+		return;
+	int i = find(p);
+	if (i >= 0)
+		unplace(i);
+	size_t n = malloc_usable_size(p);
+	heap.used -= n < heap.used? n: heap.used;
+	heap.frees++;
+}
+
+extern "C" {
+void *__wrap_malloc(size_t n) {
+	void *p = __real_malloc(n);
+	allocated(p, n);
+	return p;
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	void *p = __real_calloc(n, size);
+	allocated(p, n * size);
+	return p;
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+	size_t was = p? malloc_usable_size(p): 0;
+	void *q = __real_realloc(p, n);
+	if (q || !n) {
+		if (!p)
+			place(q, n);
+		else if (!q) {
+			int i = find(p);
+			if (i >= 0)
+				unplace(i);
+		} else
+			replace(p, q, n);
+		heap.used -= was < heap.used? was: heap.used;
+		if (q)
+			heap.used += malloc_usable_size(q);
+		if (heap.used > heap.peak)
+			heap.peak = heap.used;
+		heap.allocs++;
+	}
+	return q;
+}
+
+void __wrap_free(void *p) {
+	freed(p);
+	__real_free(p);
+}
+}
+
+void heap_reset_peak() {
+	heap.peak = heap.used;
+}
+
+void *untracked_alloc(size_t n) {
+	return __real_calloc(1, n);
+}
+
+void untracked_free(void *p) {
+	__real_free(p);
+}
+
+void *operator new(size_t n) {
+	void *p = malloc(n? n: 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t n) {
+	return operator new(n);
+}
+
+void *operator new(size_t n, const std::nothrow_t &) noexcept {
+	return malloc(n? n: 1);
+}
+
+void *operator new[](size_t n, const std::nothrow_t &) noexcept {
+	return malloc(n? n: 1);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
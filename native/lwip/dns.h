@@ -0,0 +1,18 @@
+#pragma once
+
+// lwIP's DNS lookup, answered at once from the host's resolver
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+#define ERR_OK		0
+#define ERR_INPROGRESS	-5
+#define ERR_ARG		-16
+
+typedef struct ip_addr {
+	uint32_t addr;	// network byte order
+} ip_addr_t;
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *addr, void *arg);
+
+err_t dns_gethostbyname(const char *name, ip_addr_t *addr, dns_found_callback found, void *arg);
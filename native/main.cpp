@@ -0,0 +1,207 @@
+// runs the providers and display on Linux: each cycle fetches the weather,
+// then paints every screen, and the timings and heap use are printed as JSON
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <ESP8266WiFi.h>
+#include <TFT_eSPI.h>
+#include <TimeLib.h>
+#include <Timezone.h>
+#include <unistd.h>
+
+#include "Configuration.h"
+#include "state.h"
+#include "display.h"
+#include "dbg.h"
+#include "providers.h"
+#include "native.h"
+
+#if !defined(PROVIDER)
+#define PROVIDER OpenWeatherMap
+#endif
+
+TFT_eSPI tft;
+bool debug;
+
+config cfg;
+Timezone *tz;
+struct Conditions conditions;
+struct Forecast forecasts[4];
+struct Statistics stats;
+
+PROVIDER provider;
+
+static const int days = sizeof(forecasts)/sizeof(forecasts[0]);
+
+#define SCREENS	7
+
+struct cycle {
+	uint8_t updated;
+	uint32_t fetch_us, paint_us[SCREENS];
+	size_t fetch_heap_peak, heap_peak, heap_used;
+	unsigned long fetch_allocs;
+};
+
+static uint8_t fetch(uint8_t what) {
+	if (!provider.fetch(what))
+		return FETCH_FAILED;
+	uint8_t updated;
+	while ((updated = provider.poll(conditions, forecasts, days)) & FETCH_PENDING)
+		yield();
+	return updated;
+}
+
+static void paint(int screen) {
+	switch (screen) {
+	case 0:
+		display_weather(conditions);
+		break;
+	case 1:
+		display_astronomy(conditions);
+		break;
+	case 6:
+		display_about(stats);
+		break;
+	default:
+		display_forecast(forecasts[screen - 2]);
+		break;
+	}
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [-d] [-f fs-dir] [-r replay-dir | -S server[:port]] [-s station] [-n cycles] [-o screen.ppm]\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	const char *fs = "data", *replay = 0, *server = 0, *station = 0, *ppm = 0;
+	int cycles = 1;
+
+	for (int opt; (opt = getopt(argc, argv, "df:r:S:s:n:o:")) != -1; )
+		switch (opt) {
+		case 'd':
+			debug = true;
+			break;
+		case 'f':
+			fs = optarg;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		case 'S':
+			server = optarg;
+			break;
+		case 's':
+			station = optarg;
+			break;
+		case 'n':
+			cycles = atoi(optarg);
+			break;
+		case 'o':
+			ppm = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+
+	fs_mount(fs);
+	if (!LittleFS.begin() || !cfg.read_file("/config.json")) {
+		fprintf(stderr, "No /config.json in %s\n", fs);
+		return 1;
+	}
+	if (station) {
+		strlcpy(cfg.station, station, sizeof(cfg.station));
+		cfg.nearest = !strcmp(station, "nearest");
+	}
+	if (server) {
+		const char *port = strchr(server, ':');
+		size_t n = port? port - server + 1: sizeof(cfg.server);
+		strlcpy(cfg.server, server, min(n, sizeof(cfg.server)));
+		cfg.server_port = port? atoi(port + 1): 80;
+	} else if (replay)
+		wifi_replay(replay);
+
+	tz = new Timezone(cfg.summer, cfg.winter);
+	tft.init();
+	tft.setRotation(cfg.rotate);
+	tft.fillScreen(TFT_BLACK);
+#if defined(FONT)
+	tft.setTextFont(FONT);
+#endif
+
+	// kept off the heap being measured
+	struct cycle *runs = (struct cycle *)untracked_alloc(cycles * sizeof(struct cycle));
+	uint32_t start = micros();
+	provider.begin();
+	uint32_t locate_us = micros() - start;
+
+	int failed = 0;
+	for (int i = 0; i < cycles; i++) {
+		struct cycle &run = runs[i];
+		conditions.epoch = 0;
+		heap_reset_peak();
+		unsigned long allocs = heap.allocs;
+
+		start = micros();
+		if (provider.combines())
+			run.updated = fetch(FETCH_CONDITIONS | FETCH_FORECASTS);
+		else
+			run.updated = fetch(FETCH_CONDITIONS) | fetch(FETCH_FORECASTS);
+		run.fetch_us = micros() - start;
+		run.fetch_heap_peak = heap.peak;
+		run.fetch_allocs = heap.allocs - allocs;
+		if (run.updated & FETCH_FAILED)
+			failed++;
+
+		for (int s = 0; s < SCREENS; s++) {
+			start = micros();
+			paint(s);
+			run.paint_us[s] = micros() - start;
+		}
+		run.heap_peak = heap.peak;
+		run.heap_used = heap.used;
+	}
+
+	if (ppm) {
+		paint(0);
+		if (!tft_dump(ppm))
+			fprintf(stderr, "Failed to write %s\n", ppm);
+	}
+
+	JsonDocument results;
+	results[F("locate_us")] = locate_us;
+	JsonArray cs = results[F("cycles")].to<JsonArray>();
+	for (int i = 0; i < cycles; i++) {
+		struct cycle &run = runs[i];
+		JsonObject c = cs.add<JsonObject>();
+		c[F("updated")] = run.updated;
+		c[F("fetch_us")] = run.fetch_us;
+		c[F("fetch_heap_peak")] = run.fetch_heap_peak;
+		c[F("fetch_allocs")] = run.fetch_allocs;
+		JsonArray paint_us = c[F("paint_us")].to<JsonArray>();
+		for (uint32_t us: run.paint_us)
+			paint_us.add(us);
+		c[F("heap_peak")] = run.heap_peak;
+		c[F("heap_used")] = run.heap_used;
+	}
+	untracked_free(runs);
+
+	JsonObject s = results[F("stats")].to<JsonObject>();
+	s[F("http_requests")] = stats.http_requests;
+	s[F("http_connects")] = stats.http_connects;
+	s[F("connect_failures")] = stats.connect_failures;
+	s[F("parse_failures")] = stats.parse_failures;
+	s[F("mem_failures")] = stats.mem_failures;
+	s[F("heap_conditions")] = stats.heap_conditions;
+	s[F("heap_forecasts")] = stats.heap_forecasts;
+	s[F("rx_bytes")] = stats.rx_bytes;
+	s[F("icon_hits")] = stats.icon_hits;
+	s[F("icon_misses")] = stats.icon_misses;
+	s[F("icon_evictions")] = stats.icon_evictions;
+	s[F("icon_hit_rate")] = stats.icon_hit_rate();
+
+	String out;
+	serializeJsonPretty(results, out);
+	puts(out.c_str());
+	return failed? 1: 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// hooks into the stand-ins, for the programs driving the sketch on Linux
+
+#include <stddef.h>
+#include <time.h>
+
+// the heap the ESP8266 would have free after booting
+#if !defined(NATIVE_HEAP)
+#define NATIVE_HEAP	40960
+#endif
+
+// the sketch's allocations, all of which are tracked
+struct heap_stats {
+	size_t used, peak;
+	unsigned long allocs, frees;
+	size_t placed;	// in the model of the ESP8266's heap
+	unsigned long overflows;	// which didn't fit in it
+};
+
+extern struct heap_stats heap;
+
+// starts the peak again from what's in use now
+void heap_reset_peak();
+
+// free in the model, and its largest free block, as ESP.getFreeHeap()
+// and ESP.getMaxFreeBlockSize() return
+size_t heap_free();
+size_t heap_max_block();
+
+// memory which isn't on the ESP8266's heap, e.g. the display's
+void *untracked_alloc(size_t n);
+void untracked_free(void *p);
+
+// from now on millis(), micros(), delay() and time() follow a clock which
+// starts at ms since boot and epoch, and only moves when it's advanced
+void clock_virtual(uint32_t ms, time_t epoch);
+void clock_advance(uint32_t ms);
+
+// ms until the next timer of any SimpleTimer is due, at most max
+uint32_t timers_due(uint32_t max);
+
+// timers which couldn't be set as all were in use, and those deleted by
+// the SimpleTimer model after a one-off timer's callback freed its slot for them
+extern unsigned long timers_full, timers_clobbered;
+
+// as if the pin's interrupt had fired
+void interrupt(uint8_t pin);
+
+// as if the request had come to the sketch's web server, method being
+// e.g. HTTP_GET; returns the status, 404 if nothing handles it
+int web_request(int method, const char *uri, const class String &body, class String &response);
+
+// the filesystem is a directory
+void fs_mount(const char *dir);
+
+// the sketch writes to its filesystem, so it can be given a copy: a new
+// directory named from the mkdtemp() template to, holding from's files
+bool fs_copy(const char *from, char *to);
+void fs_remove(const char *dir);
+
+// responses are read from files under dir, named by host and path,
+// e.g. dir/api.open-meteo.com/v1/forecast, instead of the network
+void wifi_replay(const char *dir);
+
+// timestamps in replayed responses are moved on by this many seconds
+void wifi_replay_shift(long seconds);
+
+// writes what's on the display as a binary PPM
+bool tft_dump(const char *filename);
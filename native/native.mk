@@ -0,0 +1,67 @@
+# make native: the providers and display built for Linux against the
+# stand-ins in native/, with ArduinoJson, Time and Timezone from ARDUINO_LIBS
+ARDUINO_LIBS ?= $(HOME)/Arduino/libraries
+
+NATIVE_BUILD := build/native-$t
+NATIVE_BIN := $(NATIVE_BUILD)/wwg
+NATIVE_BENCH := $(NATIVE_BUILD)/wwg-bench
+NATIVE_SOAK := $(NATIVE_BUILD)/wwg-soak
+NATIVE_TEST := $(NATIVE_BUILD)/wwg-test
+NATIVE_SRCS := providers.cpp openmeteo.cpp owm.cpp display.cpp Configuration.cpp inflate.cpp arena.cpp \
+	$(filter-out main.cpp bench.cpp soak.cpp test.cpp,$(notdir $(wildcard native/*.cpp))) Time.cpp Timezone.cpp
+NATIVE_OBJS := $(addprefix $(NATIVE_BUILD)/,$(NATIVE_SRCS:.cpp=.o))
+NATIVE_SKETCH := $(addprefix $(NATIVE_BUILD)/,WifiWeatherGuy.o snapshot.o fastconnect.o)
+
+NATIVE_CPPFLAGS := $(CPPFLAGS) -DARDUINO=10819 -I. -Inative \
+	-I$(ARDUINO_LIBS)/ArduinoJson/src -I$(ARDUINO_LIBS)/Time -I$(ARDUINO_LIBS)/Timezone/src
+NATIVE_CXXFLAGS ?= -std=gnu++17 -O2 -g -Wall
+NATIVE_LDFLAGS := -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free,--wrap=time
+
+vpath %.cpp . native $(ARDUINO_LIBS)/Time $(ARDUINO_LIBS)/Timezone/src
+
+native: $(FS_DIR) $(NATIVE_BIN) $(NATIVE_BENCH) $(NATIVE_SOAK) $(NATIVE_TEST)
+
+# e.g. make native-run ARGS="-n 10 -o weather.ppm"
+native-run: native
+	$(NATIVE_BIN) -f $(FS_DIR) -r native/replay -s nearest $(ARGS)
+
+# e.g. make native-bench ARGS="-n 500 -s parse/" >bench.json
+native-bench: native
+	@$(NATIVE_BENCH) -f $(FS_DIR) -c native/bench $(ARGS)
+
+$(NATIVE_BIN): $(NATIVE_BUILD)/main.o $(NATIVE_OBJS)
+	$(CXX) $(NATIVE_CXXFLAGS) -o $@ $^ $(NATIVE_LDFLAGS)
+
+$(NATIVE_BENCH): $(NATIVE_BUILD)/bench.o $(NATIVE_OBJS)
+	$(CXX) $(NATIVE_CXXFLAGS) -o $@ $^ $(NATIVE_LDFLAGS)
+
+# e.g. make native-soak ARGS="-D 60 -m 0xfc000000" >soak.json
+native-soak: native
+	@$(NATIVE_SOAK) -f $(FS_DIR) -r native/replay $(ARGS)
+
+native-test: native
+	$(NATIVE_TEST) -f $(FS_DIR) -c native/bench -r native/replay
+
+# the sketch itself, with everything it needs from the device
+$(NATIVE_SOAK): $(NATIVE_BUILD)/soak.o $(NATIVE_SKETCH) $(NATIVE_OBJS)
+	$(CXX) $(NATIVE_CXXFLAGS) -o $@ $^ $(NATIVE_LDFLAGS)
+
+# zlib compresses what's inflated
+$(NATIVE_TEST): $(NATIVE_BUILD)/test.o $(NATIVE_SKETCH) $(NATIVE_OBJS)
+	$(CXX) $(NATIVE_CXXFLAGS) -o $@ $^ $(NATIVE_LDFLAGS) -lz
+
+$(NATIVE_BUILD)/WifiWeatherGuy.o: WifiWeatherGuy.ino | $(NATIVE_BUILD)
+	$(CXX) $(NATIVE_CPPFLAGS) $(NATIVE_CXXFLAGS) -MMD -x c++ -include Arduino.h -c -o $@ $<
+
+$(NATIVE_BUILD)/%.o: %.cpp | $(NATIVE_BUILD)
+	$(CXX) $(NATIVE_CPPFLAGS) $(NATIVE_CXXFLAGS) -MMD -c -o $@ $<
+
+$(NATIVE_BUILD):
+	mkdir -p $@
+
+native-clean:
+	rm -rf $(NATIVE_BUILD)
+
+-include $(NATIVE_OBJS:.o=.d) $(NATIVE_SKETCH:.o=.d) $(addprefix $(NATIVE_BUILD)/,main.d bench.d soak.d test.d)
+
+.PHONY: native native-run native-bench native-soak native-test native-clean
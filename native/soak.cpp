@@ -0,0 +1,372 @@
+// runs the sketch's setup() and loop() against a virtual clock, which skips
+// ahead to the next timer while nothing's being fetched; what it fetched,
+// how long loop() took and the heap over time are printed as JSON. Its
+// timers are native/SimpleTimer's model of the library's, so the sketch's
+// scheduling is only checked against that
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServer.h>
+#include <TFT_eSPI.h>
+#include <Timezone.h>
+#include <unistd.h>
+
+#include "Configuration.h"
+#include "state.h"
+#include "providers.h"
+#include "arena.h"
+#include "native.h"
+
+#if !defined(PROVIDER)
+#define PROVIDER OpenWeatherMap
+#endif
+
+#if !defined(SWITCH)
+#define SWITCH	D3
+#endif
+
+// as in the sketch
+#define JITTER	30
+
+// ms, the longest the clock skips at once
+#define MAX_IDLE	60000
+
+// a fetch is late if it's this much after it was due, allowing for jitter
+#define LATE_SLACK	(60000 + 1000 * JITTER)
+
+void setup();
+void loop();
+
+extern struct Conditions conditions;
+extern PROVIDER provider;
+
+// the recorded responses are of the weather at this time
+static time_t recorded = 1729170000;
+
+// loop() times, in us of real time
+struct latencies {
+	uint32_t *us;
+	size_t n, size;
+	uint32_t max;
+};
+
+static void add(struct latencies &l, uint32_t us) {
+	if (l.n == l.size) {
+		size_t size = l.size? 2 * l.size: 4096;
+		uint32_t *p = (uint32_t *)untracked_alloc(size * sizeof(uint32_t));
+		if (l.us) {
+			memcpy(p, l.us, l.n * sizeof(uint32_t));
+			untracked_free(l.us);
+		}
+		l.us = p;
+		l.size = size;
+	}
+	l.us[l.n++] = us;
+	if (us > l.max)
+		l.max = us;
+}
+
+static int cmp(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y? -1: x > y;
+}
+
+static void report(JsonObject o, struct latencies &l) {
+	qsort(l.us, l.n, sizeof(uint32_t), cmp);
+	o[F("loops")] = l.n;
+	if (l.n) {
+		o[F("p50_us")] = l.us[(l.n - 1) / 2];
+		o[F("p90_us")] = l.us[(l.n - 1) * 9 / 10];
+		o[F("p99_us")] = l.us[(l.n - 1) * 99 / 100];
+	}
+	o[F("max_us")] = l.max;
+	untracked_free(l.us);
+}
+
+// successful fetches of one kind, and the gaps between them
+struct fetches {
+	const char *name;
+	uint32_t last;		// stats.last_fetch_*
+	uint64_t at;		// when it was seen, in ms since setup()
+	unsigned n, late, early;
+	uint64_t max_gap;
+};
+
+static void fetched(struct fetches &f, uint32_t last, uint64_t now, uint32_t interval, uint32_t slack, bool debug) {
+	if (last == f.last)
+		return;
+	if (f.n) {
+		uint64_t gap = now - f.at;
+		if (gap > f.max_gap)
+			f.max_gap = gap;
+		if (gap > interval + slack)
+			f.late++;
+		else if (gap < interval / 2)
+			f.early++;
+		if (debug)
+			fprintf(stderr, "%8.3f h: %s after %llu s\n", now / 3600000.0, f.name, (unsigned long long)gap / 1000);
+	}
+	f.last = last;
+	f.at = now;
+	f.n++;
+}
+
+static void report(JsonObject o, struct fetches &f) {
+	o[F("fetches")] = f.n;
+	o[F("late")] = f.late;
+	o[F("early")] = f.early;
+	o[F("max_gap_s")] = f.max_gap / 1000;
+}
+
+// least squares, per day
+static double slope(const double *x, const double *y, int n) {
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	for (int i = 0; i < n; i++) {
+		sx += x[i];
+		sy += y[i];
+		sxx += x[i] * x[i];
+		sxy += x[i] * y[i];
+	}
+	double d = n * sxx - sx * sx;
+	return d? (n * sxy - sx * sy) / d: 0;
+}
+
+// so it joins the network and fetches, from the server if there is one
+static bool configure(const char *server) {
+	JsonDocument doc;
+	File f = LittleFS.open("/config.json", "r");
+	if (!f || deserializeJson(doc, f))
+		return false;
+	f.close();
+
+	if (!*(doc[F("ssid")] | ""))
+		doc[F("ssid")] = F("native");
+	if (!*(doc[F("station")] | ""))
+		doc[F("nearest")] = true;
+	if (server) {
+		const char *port = strchr(server, ':');
+		doc[F("server")] = port? String(server).substring(0, port - server): String(server);
+		doc[F("server_port")] = port? atoi(port + 1): 80;
+	}
+
+	f = LittleFS.open("/config.json", "w");
+	if (!f)
+		return false;
+	serializeJson(doc, f);
+	f.close();
+	return true;
+}
+
+static uint64_t real_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [-d] [-f fs-dir] [-r replay-dir | -S server[:port]] [-D days] [-m start-ms]\n"
+		"\t[-e epoch] [-q shift-s] [-p presses/day] [-g stats-minutes] [-i sample-minutes]\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	const char *fs = "data", *replay = "native/replay", *server = 0;
+	double days = 7;
+	uint32_t start_ms = 0, quantum = 900, presses = 0, poll_min = 0, sample_min = 60;
+	time_t epoch = 0;
+	bool verbose = false;
+
+	for (int opt; (opt = getopt(argc, argv, "df:r:S:D:m:e:q:p:g:i:")) != -1; )
+		switch (opt) {
+		case 'd':
+			verbose = true;
+			break;
+		case 'f':
+			fs = optarg;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		case 'S':
+			server = optarg;
+			break;
+		case 'D':
+			days = atof(optarg);
+			break;
+		case 'm':
+			start_ms = strtoul(optarg, 0, 0);
+			break;
+		case 'e':
+			epoch = atol(optarg);
+			break;
+		case 'q':
+			quantum = atoi(optarg);
+			break;
+		case 'p':
+			presses = atoi(optarg);
+			break;
+		case 'g':
+			poll_min = atoi(optarg);
+			break;
+		case 'i':
+			sample_min = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	if (days <= 0 || !sample_min)
+		usage(argv[0]);
+
+	char dir[] = "/tmp/wwg-soak-XXXXXX";
+	if (!fs_copy(fs, dir)) {
+		fprintf(stderr, "Can't copy %s\n", fs);
+		return 1;
+	}
+	fs_mount(dir);
+	if (!LittleFS.begin() || !configure(server)) {
+		fprintf(stderr, "No /config.json in %s\n", fs);
+		fs_remove(dir);
+		return 1;
+	}
+
+	// the replayed weather moves on with the clock
+	if (!epoch)
+		epoch = server? time(0): recorded + 60;
+	if (!server)
+		wifi_replay(replay);
+	clock_virtual(start_ms, epoch);
+	randomSeed(1);
+
+	uint64_t started = real_us();
+	setup();
+
+	struct fetches updates = { "conditions" }, forecast_updates = { "forecasts" };
+	struct latencies all = {}, busy = {};
+	const uint64_t end = days * 86400000;
+	const uint32_t press_every = presses? 86400000 / presses: 0;
+	uint64_t now = 0, next_press = press_every, next_poll = 60000 * poll_min, next_sample = 0;
+	uint32_t last_ms = millis();
+	unsigned stats_polls = 0, stats_failures = 0;
+	bool was_busy = false;
+
+	JsonDocument results;
+	JsonArray samples = results[F("samples")].to<JsonArray>();
+	int nsamples = 0, max_samples = end / (60000 * sample_min) + 1;
+	double *hours = (double *)untracked_alloc(3 * max_samples * sizeof(double));
+	double *free_heap = hours + max_samples, *max_block = free_heap + max_samples;
+	size_t min_free = SIZE_MAX, min_block = SIZE_MAX;
+
+	while (now < end) {
+		bool fetching = provider.fetching();
+		uint64_t t = real_us();
+		loop();
+		uint32_t us = real_us() - t;
+		fetching = fetching || provider.fetching();
+		add(all, us);
+		if (fetching)
+			add(busy, us);
+
+		uint32_t ms = millis();
+		now += ms - last_ms;
+		last_ms = ms;
+		if (!server)
+			wifi_replay_shift((time(0) - recorded) / quantum * quantum);
+
+		uint32_t slack = cfg.combine_window + LATE_SLACK + 1000 * (uint32_t)conditions.interval;
+		fetched(updates, stats.last_fetch_conditions, now, cfg.conditions_interval, slack, verbose);
+		fetched(forecast_updates, stats.last_fetch_forecasts, now, cfg.forecasts_interval, slack, verbose);
+
+		size_t free = heap_free(), block = heap_max_block();
+		min_free = min(min_free, free);
+		min_block = min(min_block, block);
+		if (now >= next_sample && nsamples < max_samples) {
+			next_sample += 60000 * sample_min;
+			hours[nsamples] = now / 3600000.0;
+			free_heap[nsamples] = free;
+			max_block[nsamples] = block;
+			nsamples++;
+
+			JsonObject s = samples.add<JsonObject>();
+			s[F("hours")] = now / 3600000.0;
+			s[F("free_heap")] = free;
+			s[F("max_free_block")] = block;
+			s[F("num_updates")] = stats.num_updates;
+			s[F("http_requests")] = stats.http_requests;
+			s[F("http_connects")] = stats.http_connects;
+			s[F("connect_failures")] = stats.connect_failures;
+			s[F("parse_failures")] = stats.parse_failures;
+			s[F("mem_failures")] = stats.mem_failures;
+			s[F("json_arena_peak")] = json_arena.peak();
+			s[F("max_loop_ms")] = stats.max_loop_ms;
+			s[F("icon_misses")] = stats.icon_misses;
+			s[F("icon_hit_rate")] = stats.icon_hit_rate();
+		}
+
+		if (press_every && now >= next_press) {
+			next_press += press_every;
+			interrupt(SWITCH);
+		}
+		if (poll_min && now >= next_poll) {
+			next_poll += 60000 * poll_min;
+			String response;
+			stats_polls++;
+			if (web_request(HTTP_GET, "/stats", String(), response) != 200)
+				stats_failures++;
+		}
+
+		// a loop or two passes between starting and finishing a fetch, and
+		// a real server's responses take real time
+		uint32_t step;
+		if (fetching || was_busy) {
+			if (server) {
+				usleep(1000);
+				step = max((real_us() - t) / 1000, (uint64_t)1);
+			} else
+				step = 1;
+		} else {
+			uint64_t next = min(next_sample, end);
+			if (press_every)
+				next = min(next, next_press);
+			if (poll_min)
+				next = min(next, next_poll);
+			step = max(timers_due(min(next - now, (uint64_t)MAX_IDLE)), (uint32_t)1);
+		}
+		was_busy = fetching;
+		clock_advance(step);
+	}
+
+	results[F("days")] = days;
+	results[F("start_ms")] = start_ms;
+	results[F("real_ms")] = (real_us() - started) / 1000;
+	results[F("wrapped")] = (uint64_t)start_ms + end > UINT32_MAX;
+	report(results[F("conditions")].to<JsonObject>(), updates);
+	report(results[F("forecasts")].to<JsonObject>(), forecast_updates);
+	results[F("http_requests")] = stats.http_requests;
+	results[F("stats_polls")] = stats_polls;
+	results[F("stats_failures")] = stats_failures;
+	report(results[F("loop")].to<JsonObject>(), all);
+	report(results[F("fetching_loop")].to<JsonObject>(), busy);
+
+	JsonObject h = results[F("heap")].to<JsonObject>();
+	h[F("min_free")] = min_free;
+	h[F("min_max_free_block")] = min_block;
+	h[F("free_per_day")] = 24 * slope(hours, free_heap, nsamples);
+	h[F("max_free_block_per_day")] = 24 * slope(hours, max_block, nsamples);
+	h[F("overflows")] = heap.overflows;
+	untracked_free(hours);
+
+	JsonObject t = results[F("timers")].to<JsonObject>();
+	t[F("full")] = timers_full;
+	t[F("clobbered")] = timers_clobbered;
+
+	bool ok = !updates.late && !updates.early && !forecast_updates.late && !forecast_updates.early
+		&& !timers_full && !timers_clobbered && !heap.overflows && !stats_failures;
+	results[F("ok")] = ok;
+
+	String out;
+	serializeJsonPretty(results, out);
+	puts(out.c_str());
+	fs_remove(dir);
+	return ok? 0: 1;
+}
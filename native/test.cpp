@@ -0,0 +1,441 @@
+// checks of behaviour which is easier to get wrong than to see on the
+// device, each printing ok or FAIL; exits with 1 if any failed
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServer.h>
+#include <TFT_eSPI.h>
+#include <Timezone.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+
+#include "Configuration.h"
+#include "state.h"
+#include "providers.h"
+#include "display.h"
+#include "dbg.h"
+#include "inflate.h"
+#include "jsonclient.h"
+#include "arena.h"
+#include "snapshot.h"
+#include "native.h"
+
+#if !defined(PROVIDER)
+#define PROVIDER OpenWeatherMap
+#endif
+
+void setup();
+void loop();
+
+extern struct Conditions conditions;
+extern struct Statistics stats;
+
+static const char *corpus = "native/bench", *fs = "data", *replay = "native/replay";
+static int failures;
+
+static void check(bool ok, const String &name) {
+	printf("%s %s\n", ok? "ok  ": "FAIL", name.c_str());
+	if (!ok)
+		failures++;
+}
+
+static bool read_file(const String &name, std::string &s) {
+	FILE *f = fopen(name.c_str(), "rb");
+	if (!f)
+		return false;
+	char buf[4096];
+	for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0; )
+		s.append(buf, n);
+	fclose(f);
+	return true;
+}
+
+static bool write_file(const std::string &name, const std::string &s) {
+	FILE *f = fopen(name.c_str(), "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(s.data(), 1, s.size(), f) == s.size();
+	return !fclose(f) && ok;
+}
+
+static bool gzip(const std::string &in, std::string &out, int level) {
+	z_stream z = {};
+	if (deflateInit2(&z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+	out.resize(deflateBound(&z, in.size()));
+	z.next_in = (Bytef *)in.data();
+	z.avail_in = in.size();
+	z.next_out = (Bytef *)&out[0];
+	z.avail_out = out.size();
+	int r = deflate(&z, Z_FINISH);
+	out.resize(z.total_out);
+	deflateEnd(&z);
+	return r == Z_STREAM_END;
+}
+
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+	return remove(path);
+}
+
+// a response for the replayed WiFiClient to send as it is
+static bool respond(const char *dir, const char *path, const std::string &response) {
+	std::string name = std::string(dir) + "/test.example";
+	mkdir(name.c_str(), 0755);
+	return write_file(name + path, response);
+}
+
+// the body JsonClient gives the parser, or FAILED
+static int fetch(JsonClient &client, const char *path, std::string &body) {
+	body.clear();
+	if (!client.start([path](Stream &s) { s.print(path); }))
+		return JsonClient::FAILED;
+	int r;
+	while ((r = client.poll()) == JsonClient::BUSY)
+		;
+	if (r == JsonClient::READY)
+		for (int c; (c = client.read()) >= 0; )
+			body += (char)c;
+	return r;
+}
+
+static std::string chunked(const std::string &body, size_t size) {
+	char line[32];
+	std::string s;
+	for (size_t i = 0; i < body.size(); i += size) {
+		std::string chunk = body.substr(i, size);
+		snprintf(line, sizeof(line), "%zx\r\n", chunk.size());
+		s += line + chunk + "\r\n";
+	}
+	return s + "0\r\n";
+}
+
+// the status line and headers are parsed, and the body framed by its
+// Content-Length or chunks, whichever it has
+static void parse_responses() {
+	char dir[] = "/tmp/wwg-test-XXXXXX";
+	if (!mkdtemp(dir)) {
+		check(false, F("http: no replay directory"));
+		return;
+	}
+	wifi_replay(dir);
+
+	const std::string json = "{\"temp\":12.3,\"name\":\"Dublin\"}\n";
+	std::string body;
+	respond(dir, "/length", "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(json.size()) + "\r\n"
+		"Cache-Control: public, max-age=600\r\nETag: \"w/1\"\r\nConnection: close\r\n"
+		"Date: Thu, 17 Oct 2024 13:00:00 GMT\r\n\r\n" + json + "not the body");
+	respond(dir, "/chunked", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n"
+		"Expires: Thu, 17 Oct 2024 13:05:00 GMT\r\nDate: Thu, 17 Oct 2024 13:00:00 GMT\r\n\r\n"
+		+ chunked(json, 5) + "X-Trailer: 1\r\n\r\n");
+	respond(dir, "/error", "HTTP/1.1 503 Service Unavailable\r\nTransfer-Encoding: chunked\r\n\r\n"
+		+ chunked(std::string(3 * DRAIN_MAX, '{'), 1000) + "\r\n");
+	respond(dir, "/status", "HTTP/1.1200\r\n\r\n{\"temp\":1}\n");
+
+	JsonClient client(F("test.example"));
+	int r = fetch(client, "/length", body);
+	check(r == JsonClient::READY && body == json, F("http: body framed by Content-Length"));
+	check(client.status() == 200 && client.max_age() == 600 && !strcmp(client.etag(), "\"w/1\"")
+		&& client.date() == 1729170000, F("http: status, Cache-Control, ETag and Date"));
+	client.end();
+
+	uint32_t connects = stats.http_connects;
+	r = fetch(client, "/chunked", body);
+	check(r == JsonClient::READY && body == json, F("http: chunked body"));
+	check(client.max_age() == 300 && !*client.etag(), F("http: Expires less Date"));
+	client.end();
+	check(stats.http_connects == connects + 1, F("http: connection closed when asked"));
+	r = fetch(client, "/chunked", body);
+	client.end();
+	check(r == JsonClient::READY && stats.http_connects == connects + 1,
+		F("http: connection reused after a chunked body"));
+
+	r = fetch(client, "/error", body);
+	check(r == JsonClient::FAILED && client.status() == 503, F("http: error status fails before its body"));
+	connects = stats.http_connects;
+	r = fetch(client, "/chunked", body);
+	client.end();
+	check(r == JsonClient::READY && stats.http_connects == connects + 1,
+		F("http: connection dropped after a chunked body longer than DRAIN_MAX"));
+
+	r = fetch(client, "/status", body);
+	check(r == JsonClient::FAILED, F("http: bad status line fails"));
+
+	wifi_replay(0);
+	nftw(dir, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+}
+
+// a document's blocks are given back in the reverse of the order they were
+// taken, and all of them by reset(), while the peak is kept
+static void arena() {
+	json_arena.reset();
+	size_t peak = json_arena.peak();
+	void *a = json_arena.allocate(100), *b = json_arena.allocate(200);
+	size_t used = json_arena.used();
+	check(a && b && used >= 300 && json_arena.peak() >= used, F("arena: allocates"));
+
+	json_arena.deallocate(a);
+	check(json_arena.used() == used, F("arena: a block below the top is kept"));
+	b = json_arena.reallocate(b, 400);
+	check(b && json_arena.used() > used, F("arena: the top block grows in place"));
+	json_arena.deallocate(b);
+	check(!json_arena.used(), F("arena: freeing the top gives back what's below"));
+
+	check(!json_arena.allocate(json_arena.size()), F("arena: too large fails"));
+	a = json_arena.allocate(100);
+	json_arena.reset();
+	check(!json_arena.used() && json_arena.peak() >= peak && json_arena.peak() >= used + 200,
+		F("arena: reset empties it and keeps the peak"));
+}
+
+// only the settings which differ are reported
+static void changes() {
+	config a = cfg, b = a;
+	check(!a.changes(b), F("changes: none"));
+
+	b.metric = !a.metric;
+	strcpy(b.station, "EIDW");
+	b.bright = a.bright + 1;
+	check(a.changes(b) == (bit(CFG_METRIC) | bit(CFG_STATION) | bit(CFG_BRIGHT)), F("changes: each setting"));
+	check(!(a.changes(b) & RESTART_SETTINGS), F("changes: applied live"));
+
+	b = a;
+	b.server_port = a.server_port + 1;
+	b.summer.hour = a.summer.hour + 1;
+	uint32_t c = a.changes(b);
+	check(c == (bit(CFG_SERVER) | bit(CFG_TIMEZONE)) && (c & RESTART_SETTINGS), F("changes: server and timezone"));
+}
+
+// a snapshot is only restored by the build which saved it
+static void snapshot() {
+	char dir[] = "/tmp/wwg-test-XXXXXX";
+	if (!mkdtemp(dir)) {
+		check(false, F("snapshot: no filesystem"));
+		return;
+	}
+	fs_mount(dir);
+
+	struct Conditions c = {}, rc;
+	struct Forecast f[4] = {}, rf[4];
+	int days = sizeof(f) / sizeof(f[0]);
+	struct Statistics s = {}, rs;
+	c.epoch = 1729170000;
+	strcpy(c.icon, "04d");
+	f[1].epoch = 1729256400;
+	s.num_updates = 7;
+	s.max_loop_ms = 99;
+	bool ok = save_snapshot(c, f, days, s) && restore_snapshot(rc, rf, days, rs);
+	check(ok && rc.epoch == c.epoch && rc.stale && !strcmp(rc.icon, "04d") && rf[1].epoch == f[1].epoch
+		&& rs.num_updates == 7 && !rs.max_loop_ms, F("snapshot: restored"));
+	check(!restore_snapshot(rc, rf, days - 1, rs) && !rc.epoch, F("snapshot: other days rejected"));
+
+	std::string saved, bad;
+	String name = String(dir) + "/snapshot.bin";
+	read_file(name, saved);
+	bad = saved;
+	bad[4]++;
+	write_file(name.c_str(), bad);
+	check(!restore_snapshot(rc, rf, days, rs) && !rc.epoch, F("snapshot: other version rejected"));
+	bad = saved;
+	bad[8]++;
+	write_file(name.c_str(), bad);
+	check(!restore_snapshot(rc, rf, days, rs), F("snapshot: other size of conditions rejected"));
+	write_file(name.c_str(), saved.substr(0, saved.size() - 1));
+	check(!restore_snapshot(rc, rf, days, rs), F("snapshot: truncated rejected"));
+
+	nftw(dir, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+}
+
+// responses no larger than the window always inflate; larger ones may
+// refer back beyond it, when inflating fails rather than going wrong
+static void inflate_responses() {
+	static const char *responses[] = {
+		"api.openweathermap.org/data/2.5/weather",
+		"api.openweathermap.org/data/2.5/forecast",
+		"api.open-meteo.com/v1/forecast",
+	};
+	for (const char *size: { "small", "medium", "large" })
+		for (const char *r: responses) {
+			std::string json, gz;
+			String name = String(corpus) + "/" + size + "/" + r;
+			if (!read_file(name, json)) {
+				check(false, String(F("inflate: no ")) + name);
+				continue;
+			}
+			for (int level: { 1, 6, 9 }) {
+				size_t pos = 0;
+				std::string out;
+				bool ok = gzip(json, gz, level);
+				Inflate inflate([&gz, &pos]() { return pos < gz.size()? (uint8_t)gz[pos++]: -1; });
+				ok = ok && inflate.begin();
+				for (int c; ok && (c = inflate.read()) >= 0; )
+					out += (char)c;
+				bool failed = inflate.failed();
+				if (json.size() <= INFLATE_WINDOW)
+					ok = ok && !failed && out == json;
+				else
+					ok = ok && (failed? !json.compare(0, out.size(), out): out == json);
+				check(ok, String(F("inflate: ")) + size + "/" + r + F(" level ") + String(level)
+					+ (failed? F(", failed"): F("")));
+			}
+		}
+}
+
+// pixels which differ between redrawing what changed from a and painting b
+static int refresh_differs(struct Conditions &a, struct Conditions &b) {
+	display_weather(a);
+	refresh_weather(b);
+	size_t n = tft.frame_width() * tft.frame_height();
+	std::vector<uint16_t> refreshed(tft.frame(), tft.frame() + n);
+	display_weather(b);
+	int d = 0;
+	for (size_t i = 0; i < n; i++)
+		if (refreshed[i] != tft.frame()[i])
+			d++;
+	return d;
+}
+
+// the weather screen is left as painting it would, e.g., after a taller
+// icon (Open-Meteo's fog) or with the wind marker moved
+static void refresh_weather_screen() {
+	fs_mount(fs);
+	clock_virtual(0, 1729170060);
+	if (!tz)
+		tz = new Timezone(cfg.summer, cfg.winter);
+	tft.init();
+
+	struct Conditions a = {};
+	a.epoch = 1729170000;
+	strcpy(a.city, "Dublin");
+	strcpy(a.weather, "Fog");
+	strcpy(a.icon, "45d");
+	a.temp = 12;
+	a.feelslike = 10;
+	a.humidity = 81;
+	a.pressure = 1012;
+	a.wind = 20;
+	a.wind_degrees = 90;
+
+	struct Conditions b = a;
+	strcpy(b.weather, "Clear sky");
+	strcpy(b.icon, "0d");
+	int d = refresh_differs(a, b);
+	check(!d, String(F("refresh: taller icon to shorter, ")) + String(d) + F(" pixels differ"));
+
+	b = a;
+	b.wind = 35;
+	b.wind_degrees = 250;
+	d = refresh_differs(a, b);
+	check(!d, String(F("refresh: wind moved, ")) + String(d) + F(" pixels differ"));
+}
+
+// the recorded conditions, observed at the same time but in Fahrenheit
+static bool fahrenheit(char *dir) {
+	static const char *responses[] = {
+		"api.openweathermap.org/data/2.5/weather",
+		"api.open-meteo.com/v1/forecast",
+	};
+	if (!mkdtemp(dir))
+		return false;
+	for (std::string r: responses) {
+		std::string body;
+		size_t t;
+		if (!read_file(String(replay) + "/" + r.c_str(), body) || (t = body.find(":12.3,")) == std::string::npos)
+			return false;
+		body.replace(t, 6, ":54.1,");
+		for (size_t i = 0; (i = r.find('/', i)) != std::string::npos; i++)
+			mkdir((dir + ("/" + r.substr(0, i))).c_str(), 0755);
+		if (!write_file(dir + ("/" + r), body))
+			return false;
+	}
+	return true;
+}
+
+static void run(uint32_t ms) {
+	for (uint32_t i = 0; i < ms; i++) {
+		loop();
+		clock_advance(1);
+	}
+}
+
+// the same observation, fetched again in new units, replaces what's shown
+static void units_change() {
+	char dir[] = "/tmp/wwg-test-XXXXXX", f_dir[] = "/tmp/wwg-test-XXXXXX";
+	if (!fs_copy(fs, dir)) {
+		check(false, String(F("units: no filesystem in ")) + fs);
+		return;
+	}
+	fs_mount(dir);
+
+	JsonDocument doc;
+	File f = LittleFS.open("/config.json", "r");
+	bool ok = f && !deserializeJson(doc, f);
+	f.close();
+	doc[F("ssid")] = F("native");
+	doc[F("nearest")] = true;
+	doc[F("metric")] = true;
+	f = LittleFS.open("/config.json", "w");
+	ok = ok && f && serializeJson(doc, f);
+	f.close();
+	if (!ok) {
+		check(false, String(F("units: no /config.json in ")) + fs);
+		fs_remove(dir);
+		return;
+	}
+
+	wifi_replay(replay);
+	clock_virtual(0, 1729170060);
+	setup();
+	run(10000);
+	check(conditions.temp == 12, String(F("units: metric ")) + String(conditions.temp));
+
+	if (fahrenheit(f_dir)) {
+		wifi_replay(f_dir);
+		doc[F("metric")] = false;
+		String body, response;
+		serializeJson(doc, body);
+		web_request(HTTP_POST, "/config", body, response);
+		run(10000);
+		check(conditions.temp == 54, String(F("units: imperial ")) + String(conditions.temp));
+	} else
+		check(false, F("units: no conditions to convert"));
+	fs_remove(dir);
+	nftw(f_dir, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [-c corpus-dir] [-f fs-dir] [-r replay-dir]\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+
+	for (int opt; (opt = getopt(argc, argv, "c:f:r:")) != -1; )
+		switch (opt) {
+		case 'c':
+			corpus = optarg;
+			break;
+		case 'f':
+			fs = optarg;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+
+	// before the clock is virtual, which JsonClient's waiting doesn't move
+	parse_responses();
+	arena();
+	changes();
+	snapshot();
+	inflate_responses();
+	refresh_weather_screen();
+	units_change();
+	return failures? 1: 0;
+}
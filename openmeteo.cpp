@@ -8,49 +8,61 @@
 #include "dbg.h"
 #include "state.h"
 #include "providers.h"
+#include "inflate.h"
 #include "jsonclient.h"
 
 OpenMeteo::OpenMeteo(): Provider(F("api.open-meteo.com")) {}
 
-void OpenMeteo::begin() {
-
-	Provider::begin();
+const __FlashStringHelper *OpenMeteo::locator() {
 
 	if (cfg.nearest)
-		return;
+		return Provider::locator();
 
-	if (!cfg.station) {
+	if (!*cfg.station) {
 		ERR(println("No City or Station configured!"));
+		return 0;
+	}
+	return F("geocoding-api.open-meteo.com");
+}
+
+void OpenMeteo::on_locate(Stream &client) {
+
+	if (cfg.nearest) {
+		Provider::on_locate(client);
 		return;
 	}
+	client.print(F("/v1/search?count=1&name="));
+	client.print(cfg.station);
+}
 
-	WiFiClient wifi;
-	JsonClient client(wifi, F("geocoding-api.open-meteo.com"));
-	auto add_path = [sta=cfg.station](Stream &s) {
-		s.print("/v1/search?count=1&name=");
-		s.print(sta);
-	};
-
-	if (client.get(add_path)) {
-
-		extern struct Conditions conditions;
-		JsonDocument doc;
-		DeserializationError error = deserializeJson(doc, wifi);
-		if (error) {
-			ERR(print(F("Deserializing geocoding-api.com response: ")));
-			ERR(println(error.f_str()));
-			return;
-		}
-
-		JsonObject results_0 = doc[F("results")][0];
-		cfg.lat = results_0[F("latitude")];
-		cfg.lon = results_0[F("longitude")];
-		strncpy_P(conditions.city, results_0[F("name")], sizeof(conditions.city));
+void OpenMeteo::location_filter(JsonDocument &filter) {
+
+	if (cfg.nearest) {
+		Provider::location_filter(filter);
+		return;
 	}
-	wifi.stop();
+	JsonObject results = filter[F("results")].add<JsonObject>();
+	results[F("latitude")] = true;
+	results[F("longitude")] = true;
+	results[F("name")] = true;
+}
+
+bool OpenMeteo::update_location(JsonDocument &doc, char *city, size_t n) {
+
+	if (cfg.nearest)
+		return Provider::update_location(doc, city, n);
+
+	JsonObject results_0 = doc[F("results")][0];
+	if (results_0.isNull())
+		return false;
+
+	cfg.lat = results_0[F("latitude")];
+	cfg.lon = results_0[F("longitude")];
+	strlcpy(city, results_0[F("name")] | "", n);
+	return true;
 }
 
-void OpenMeteo::on_connect(Stream &client, bool is_fetch_conditions) {
+void OpenMeteo::on_connect(Stream &client, uint8_t what) {
 
 	client.print(F("/v1/forecast"));
 	client.print(F("?latitude="));
@@ -64,11 +76,35 @@ void OpenMeteo::on_connect(Stream &client, bool is_fetch_conditions) {
 	else
 		client.print(F("&temperature_unit=fahrenheit&wind_speed_unit=mph&precipitation_unit=inch"));
 
-	if (is_fetch_conditions)
-		client.print(F("&hourly=temperature_2m&forecast_hours=0&current=temperature_2m,relative_humidity_2m,apparent_temperature,is_day,weather_code,surface_pressure,wind_speed_10m,wind_direction_10m&forecast_days=1&daily=sunrise,sunset"));
+	client.print(F("&hourly=temperature_2m&forecast_hours=0&current="));
+	if (what & FETCH_CONDITIONS)
+		client.print(F("temperature_2m,relative_humidity_2m,apparent_temperature,is_day,weather_code,surface_pressure,wind_speed_10m,wind_direction_10m"));
+	else
+		client.print(F("temperature_2m"));
 
+	if (what & FETCH_FORECASTS)
+		client.print(F("&daily=weather_code,temperature_2m_max,temperature_2m_min,sunrise,sunset,wind_speed_10m_max,wind_gusts_10m_max,wind_direction_10m_dominant&forecast_days=7"));
 	else
-		client.print(F("&hourly=temperature_2m&forecast_hours=0&current=temperature_2m&daily=weather_code,temperature_2m_max,temperature_2m_min,apparent_temperature_max,apparent_temperature_min,sunrise,sunset,wind_speed_10m_max,wind_gusts_10m_max,wind_direction_10m_dominant&forecast_days=7"));
+		client.print(F("&daily=sunrise,sunset&forecast_days=1"));
+}
+
+void OpenMeteo::conditions_filter(JsonDocument &filter) {
+
+	JsonObject current = filter[F("current")].to<JsonObject>();
+	current[F("time")] = true;
+	current[F("interval")] = true;
+	current[F("temperature_2m")] = true;
+	current[F("apparent_temperature")] = true;
+	current[F("relative_humidity_2m")] = true;
+	current[F("is_day")] = true;
+	current[F("weather_code")] = true;
+	current[F("surface_pressure")] = true;
+	current[F("wind_speed_10m")] = true;
+	current[F("wind_direction_10m")] = true;
+
+	// merges with the forecasts' when fetched together
+	filter[F("daily")][F("sunrise")] = true;
+	filter[F("daily")][F("sunset")] = true;
 }
 
 bool OpenMeteo::update_conditions(JsonDocument &doc, struct Conditions &c) {
@@ -86,6 +122,7 @@ bool OpenMeteo::update_conditions(JsonDocument &doc, struct Conditions &c) {
 	strncpy_P(c.moon_phase, moon_phase(c.age_of_moon), sizeof(c.moon_phase));
 
 	int current_interval = current[F("interval")];
+	c.interval = current_interval;
 	float current_temperature_2m = current[F("temperature_2m")];
 	c.temp = (int)(0.5 + current_temperature_2m);
 
@@ -111,7 +148,6 @@ bool OpenMeteo::update_conditions(JsonDocument &doc, struct Conditions &c) {
 	c.wind_degrees = current_wind_direction_10m;
 	
 	const JsonObject &daily = doc[F("daily")];
-	long daily_time_0 = daily[F("time")][0];
 	long daily_sunrise_0 = daily[F("sunrise")][0];
 	time_t sunrise = (time_t)daily_sunrise_0;
 	struct tm *sr = gmtime(&sunrise);
@@ -127,20 +163,24 @@ bool OpenMeteo::update_conditions(JsonDocument &doc, struct Conditions &c) {
 	return true;
 }
 
+void OpenMeteo::forecasts_filter(JsonDocument &filter) {
+
+	filter[F("daily")][F("time")] = true;
+	filter[F("daily")][F("weather_code")] = true;
+	filter[F("daily")][F("temperature_2m_max")] = true;
+	filter[F("daily")][F("temperature_2m_min")] = true;
+	filter[F("daily")][F("wind_speed_10m_max")] = true;
+	filter[F("daily")][F("wind_gusts_10m_max")] = true;
+	filter[F("daily")][F("wind_direction_10m_dominant")] = true;
+}
+
 bool OpenMeteo::update_forecasts(JsonDocument &doc, struct Forecast forecasts[], int days) {
 
-	JsonObject current = doc[F("current")];
-	long current_time = current[F("time")];
-	
 	JsonObject daily = doc[F("daily")];
 	JsonArray daily_time = daily[F("time")];
 	JsonArray daily_weather_code = daily[F("weather_code")];
 	JsonArray daily_temperature_2m_max = daily[F("temperature_2m_max")];
 	JsonArray daily_temperature_2m_min = daily[F("temperature_2m_min")];
-	JsonArray daily_apparent_temperature_max = daily[F("apparent_temperature_max")];
-	JsonArray daily_apparent_temperature_min = daily[F("apparent_temperature_min")];
-	JsonArray daily_sunrise = daily[F("sunrise")];
-	JsonArray daily_sunset = daily[F("sunset")];
 	JsonArray daily_wind_speed_10m_max = daily[F("wind_speed_10m_max")];
 	JsonArray daily_wind_gusts_10m_max = daily[F("wind_gusts_10m_max")];
 	JsonArray daily_wind_direction_10m_dominant = daily[F("wind_direction_10m_dominant")];
@@ -161,11 +201,6 @@ bool OpenMeteo::update_forecasts(JsonDocument &doc, struct Forecast forecasts[],
 		float daily_temperature_2m_min_i = daily_temperature_2m_min[i];
 		f.temp_low = (int)(0.5 + daily_temperature_2m_min_i);
 
-		float daily_apparent_temperature_max_i = daily_apparent_temperature_max[i];
-		float daily_apparent_temperature_min_i = daily_apparent_temperature_min[i];
-		long daily_sunrise_i = daily_sunrise[i];
-		long daily_sunset_i = daily_sunset[i];
-
 		float daily_wind_speed_10m_max_i = daily_wind_speed_10m_max[i];
 		f.ave_wind = (int)(0.5 + daily_wind_speed_10m_max_i);
 
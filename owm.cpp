@@ -9,12 +9,13 @@
 #include "state.h"
 #include "providers.h"
 #include "dbg.h"
+#include "arena.h"
 
 OpenWeatherMap::OpenWeatherMap(): Provider(F("api.openweathermap.org")) {}
 
-void OpenWeatherMap::on_connect(Stream &client, bool conds) {
+void OpenWeatherMap::on_connect(Stream &client, uint8_t what) {
 	client.print(F("/data/2.5/"));
-	if (conds)
+	if (what & FETCH_CONDITIONS)
 		client.print(F("weather"));
 	else
 		client.print(F("forecast"));
@@ -29,9 +30,6 @@ void OpenWeatherMap::on_connect(Stream &client, bool conds) {
 		client.print(cfg.station);
 	}
 
-	if (!conds)
-		client.print(F("&cnt=16"));
-
 	client.print(F("&appid="));
 	client.print(cfg.key);
 	client.print(F("&units="));
@@ -41,6 +39,32 @@ void OpenWeatherMap::on_connect(Stream &client, bool conds) {
 		client.print(F("imperial"));
 }
 
+void OpenWeatherMap::conditions_filter(JsonDocument &filter) {
+
+	filter[F("dt")] = true;
+	filter[F("name")] = true;
+
+	JsonObject w = filter[F("weather")].add<JsonObject>();
+	w[F("description")] = true;
+	w[F("main")] = true;
+	w[F("icon")] = true;
+
+	JsonObject main = filter[F("main")].to<JsonObject>();
+	main[F("temp")] = true;
+	main[F("temp_min")] = true;
+	main[F("pressure")] = true;
+	main[F("humidity")] = true;
+
+	JsonObject wind = filter[F("wind")].to<JsonObject>();
+	wind[F("speed")] = true;
+	wind[F("deg")] = true;
+
+	JsonObject sys = filter[F("sys")].to<JsonObject>();
+	sys[F("sunrise")] = true;
+	sys[F("sunset")] = true;
+	sys[F("country")] = true;
+}
+
 bool OpenWeatherMap::update_conditions(JsonDocument &root, struct Conditions &c) {
 	time_t epoch = tz->toLocal((time_t)root[F("dt")]);
 
@@ -55,7 +79,7 @@ bool OpenWeatherMap::update_conditions(JsonDocument &root, struct Conditions &c)
 
 	const JsonObject &w = root[F("weather")][0];
 	const char *desc = w[F("description")] | "";
-	int l = strlen(desc);
+	size_t l = strlen(desc);
 	if (l >= sizeof(c.weather) || l == 0)
 		desc = w[F("main")] | "";
 	strlcpy(c.weather, desc, sizeof(c.weather));
@@ -89,28 +113,139 @@ bool OpenWeatherMap::update_conditions(JsonDocument &root, struct Conditions &c)
 }
 
 
-bool OpenWeatherMap::update_forecasts(JsonDocument &root, struct Forecast fs[], int n) {
-	int cnt = root[F("cnt")];
-	const JsonArray &list = root[F("list")];
+// the filter for one element of the forecast list
+void OpenWeatherMap::forecasts_filter(JsonDocument &filter) {
+
+	filter[F("dt")] = true;
 
-	for (int i = 0, j = 0; i < n && j < cnt; i++, j += 2) {
-		struct Forecast &f = fs[i];
+	JsonObject main = filter[F("main")].to<JsonObject>();
+	main[F("temp_max")] = true;
+	main[F("temp_min")] = true;
+	main[F("humidity")] = true;
 
-		const JsonObject &fc = list[j];
+	JsonObject weather = filter[F("weather")].add<JsonObject>();
+	weather[F("description")] = true;
+	weather[F("icon")] = true;
+
+	JsonObject wind = filter[F("wind")].to<JsonObject>();
+	wind[F("deg")] = true;
+	wind[F("speed")] = true;
+}
+
+// a day's worth of 3-hourly forecasts, as they're folded together
+struct Day {
+	time_t date;
+	int n;
+	long humidity;
+	float wind, wind_x, wind_y;
+	struct {
+		char icon[3];
+		char description[32];
+		uint8_t count;
+	} conditions[8];
+	int ncond;
+};
+
+static void fold(struct Day &d, struct Forecast &f, JsonDocument &fc) {
+
+	const JsonObject &main = fc[F("main")];
+	int temp_max = main[F("temp_max")], temp_min = main[F("temp_min")];
+	if (!d.n) {
 		f.epoch = fc[F("dt")];
+		f.temp_high = temp_max;
+		f.temp_low = temp_min;
+		f.max_wind = 0;
+	} else {
+		if (temp_max > f.temp_high)
+			f.temp_high = temp_max;
+		if (temp_min < f.temp_low)
+			f.temp_low = temp_min;
+	}
+	d.n++;
+	d.humidity += (int)main[F("humidity")];
+
+	const JsonObject &wind = fc[F("wind")];
+	float speed = float(wind[F("speed")]) * 3.6;
+	float deg = float(wind[F("deg")]) * DEG_TO_RAD;
+	d.wind += speed;
+	d.wind_x += speed * sin(deg);
+	d.wind_y += speed * cos(deg);
+	if (ceil(speed) > f.max_wind)
+		f.max_wind = ceil(speed);
+
+	// tally conditions by icon, ignoring day or night
+	const JsonObject &weather = fc[F("weather")][0];
+	const char *icon = weather[F("icon")] | "";
+	int i;
+	for (i = 0; i < d.ncond; i++)
+		if (!strncmp(d.conditions[i].icon, icon, 2))
+			break;
+	if (i == d.ncond) {
+		if (d.ncond == sizeof(d.conditions) / sizeof(d.conditions[0]))
+			return;
+		d.ncond++;
+		strlcpy(d.conditions[i].icon, icon, sizeof(d.conditions[i].icon));
+		strlcpy(d.conditions[i].description, weather[F("description")] | "", sizeof(d.conditions[i].description));
+		d.conditions[i].count = 0;
+	}
+	d.conditions[i].count++;
+}
 
-		const JsonObject &main = fc[F("main")];
-		f.temp_high = main[F("temp_max")];
-		f.temp_low = main[F("temp_min")];
-		f.humidity = main[F("humidity")];
+static void summarise(struct Day &d, struct Forecast &f) {
 
-		const JsonObject &weather = fc[F("weather")][0];
-		strlcpy(f.conditions, weather[F("description")], sizeof(f.conditions));
-		strlcpy(f.icon, weather[F("icon")], sizeof(f.icon));
+	f.humidity = d.humidity / d.n;
+	f.ave_wind = ceil(d.wind / d.n);
+	int deg = round(atan2(d.wind_x, d.wind_y) * RAD_TO_DEG);
+	f.wind_degrees = deg < 0? deg + 360: deg;
 
-		const JsonObject &wind = fc[F("wind")];
-		f.wind_degrees = wind[F("deg")];
-		f.ave_wind = ceil(float(wind[F("speed")]) * 3.6);
+	int dominant = 0;
+	for (int i = 1; i < d.ncond; i++)
+		if (d.conditions[i].count > d.conditions[dominant].count)
+			dominant = i;
+	strlcpy(f.conditions, d.conditions[dominant].description, sizeof(f.conditions));
+	snprintf(f.icon, sizeof(f.icon), "%sd", d.conditions[dominant].icon);
+}
+
+// the forecast list is parsed one element at a time, each being folded
+// into the day it belongs to, so the 40 entries needn't fit in memory
+bool OpenWeatherMap::stream_forecasts(Stream &s, struct Forecast fs[], int n) {
+
+	if (!s.find("\"list\":[")) {
+		ERR(println(F("No forecast list!")));
+		stats.parse_failures++;
+		return false;
 	}
+
+	JsonDocument filter(&json_arena);
+	forecasts_filter(filter);
+	stats.heap_forecasts = 0;
+
+	struct Day d;
+	int i = -1;
+	do {
+		JsonDocument fc(&json_arena);
+		uint32_t heap;
+		DeserializationError error = deserialize(fc, s, filter, heap);
+		if (error) {
+			ERR(print(F("Deserialization of Forecasts failed: ")));
+			ERR(println(error.f_str()));
+			return false;
+		}
+		if (heap > stats.heap_forecasts)
+			stats.heap_forecasts = heap;
+
+		time_t date = tz->toLocal((time_t)fc[F("dt")]) / SECS_PER_DAY;
+		if (i < 0 || date != d.date) {
+			if (i >= 0)
+				summarise(d, fs[i]);
+			if (++i == n)
+				return true;
+			memset(&d, 0, sizeof(d));
+			d.date = date;
+		}
+		fold(d, fs[i], fc);
+	} while (s.findUntil(",", "]"));
+
+	summarise(d, fs[i]);
 	return true;
 }
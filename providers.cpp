@@ -1,85 +1,293 @@
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
 #include <ArduinoJson.h>
+#include <LittleFS.h>
 #include <Timezone.h>
 
 #include "Configuration.h"
 #include "providers.h"
 #include "state.h"
 #include "dbg.h"
+#include "inflate.h"
 #include "jsonclient.h"
+#include "arena.h"
 
-void Provider::begin() {
+// resolved locations are cached, keyed by the station looked up
+#define LOCATION_FILE	"/location.json"
+#define LOCATION_TTL	(7 * 86400)
 
-	if (!cfg.nearest)
+static uint32_t location_key() {
+	// FNV-1a
+	uint32_t h = 2166136261;
+	for (const char *p = cfg.nearest? "": cfg.station; *p; p++) {
+		h ^= (uint8_t)*p;
+		h *= 16777619;
+	}
+	return h;
+}
+
+bool Provider::read_location(struct Conditions &conditions) {
+
+	File f = LittleFS.open(LOCATION_FILE, "r");
+	if (!f)
+		return false;
+
+	JsonDocument doc(&json_arena);
+	DeserializationError error = deserializeJson(doc, f);
+	f.close();
+	if (error || doc[F("key")] != location_key())
+		return false;
+
+	cfg.lat = doc[F("lat")];
+	cfg.lon = doc[F("lon")];
+	strlcpy(conditions.city, doc[F("city")] | "", sizeof(conditions.city));
+	_located = doc[F("time")];
+	return true;
+}
+
+void Provider::write_location(struct Conditions &conditions) {
+
+	JsonDocument doc(&json_arena);
+	doc[F("key")] = location_key();
+	doc[F("lat")] = cfg.lat;
+	doc[F("lon")] = cfg.lon;
+	doc[F("city")] = conditions.city;
+	doc[F("time")] = _located;
+
+	File f = LittleFS.open(LOCATION_FILE, "w");
+	if (!f) {
+		ERR(println(F("Failed to cache location")));
 		return;
+	}
+	serializeJson(doc, f);
+	f.close();
+}
 
-	WiFiClient wifi;
-	JsonClient client(wifi, F("ip-api.com"));
-	if (client.get("/json")) {
-		extern struct Conditions conditions;
-		JsonDocument geo;
-
-		DeserializationError error = deserializeJson(geo, wifi);
-		if (error) {
-			ERR(print(F("Deserializing ip-api.com response: ")));
-			ERR(println(error.f_str()));
-		} else {
-			cfg.lat = geo["lat"];
-			cfg.lon = geo["lon"];
-			strncpy(conditions.city, geo["city"], sizeof(conditions.city));
-			cfg.nearest = true;
-		}
+bool Provider::begin() {
+
+	extern struct Conditions conditions;
+	if (read_location(conditions)) {
+		DBG(print(F("Cached location: ")));
+		DBG(println(conditions.city));
+		return true;
 	}
-	wifi.stop();
-}
-
-bool Provider::fetch_conditions(struct Conditions &conditions) {
-
-	WiFiClient wifi;
-	JsonClient client(wifi, _host);
-	bool ret = false;
-
-	if (client.get([&](Stream &s) { on_connect(s, true); })) {
-		JsonDocument doc;
-		DeserializationError error = deserializeJson(doc, wifi);
-		if (error) {
-			ERR(print(F("Deserialization of Conditions failed: ")));
-			ERR(println(error.f_str()));
-			stats.parse_failures++;
-		} else {
-			ret = update_conditions(doc, conditions);
-			if (ret)
-				stats.num_updates++;
-			DBG(print(F("Done ")));
-		}
+	if (!locator())
+		return true;
+
+	// the first time, the weather can't be fetched without it
+	uint8_t updated = 0;
+	if (fetch(FETCH_LOCATION))
+		while ((updated = poll(conditions, 0, 0)) & FETCH_PENDING)
+			yield();
+	return updated & FETCH_LOCATION;
+}
+
+bool Provider::location_stale() {
+
+	time_t now = time(0);
+	if (!locator() || now < 1600000000)
+		return false;
+	return !_located || now - _located > LOCATION_TTL;
+}
+
+bool Provider::relocate(struct Conditions &conditions) {
+
+	_located = 0;
+	return !locator() || read_location(conditions);
+}
+
+const __FlashStringHelper *Provider::locator() {
+
+	return cfg.nearest? F("ip-api.com"): 0;
+}
+
+void Provider::on_locate(Stream &client) {
+
+	client.print(F("/json"));
+}
+
+void Provider::location_filter(JsonDocument &filter) {
+
+	filter[F("lat")] = true;
+	filter[F("lon")] = true;
+	filter[F("city")] = true;
+}
+
+bool Provider::update_location(JsonDocument &doc, char *city, size_t n) {
+
+	if (!doc[F("lat")].is<float>())
+		return false;
+
+	cfg.lat = doc[F("lat")];
+	cfg.lon = doc[F("lon")];
+	strlcpy(city, doc[F("city")] | "", n);
+	return true;
+}
+
+bool Provider::parse_location(Stream &s, struct Conditions &conditions) {
+
+	JsonDocument filter(&json_arena), doc(&json_arena);
+	location_filter(filter);
+	uint32_t heap;
+	DeserializationError error = deserialize(doc, s, filter, heap);
+	if (error) {
+		ERR(print(F("Deserializing location: ")));
+		ERR(println(error.f_str()));
+		return false;
 	}
-	wifi.stop();
-	return ret;
+	if (!update_location(doc, conditions.city, sizeof(conditions.city))) {
+		ERR(println(F("Location not found")));
+		return false;
+	}
+
+	_located = _client->date();
+	if (!_located)
+		_located = time(0);
+	write_location(conditions);
+	return true;
 }
 
-bool Provider::fetch_forecasts(struct Forecast forecasts[], int days) {
+bool Provider::fetch(uint8_t what) {
 
-	WiFiClient wifi;
-	JsonClient client(wifi, _host);
-	bool ret = false;
+	if (_client)
+		return false;
 
-	if (client.get([&](Stream &s) { on_connect(s, false); })) {
-		JsonDocument doc;
-		DeserializationError error = deserializeJson(doc, wifi);
-		if (error) {
-			ERR(print(F("Deserialization of Forecasts failed: ")));
-			ERR(println(error.f_str()));
-			stats.parse_failures++;
-		} else {
-			ret = update_forecasts(doc, forecasts, days);
-			DBG(print(F("Done ")));
+	const __FlashStringHelper *host = what == FETCH_LOCATION? locator(): _host;
+	if (!host)
+		return false;
+
+	_fetching = what;
+	_client = new JsonClient(host);
+	if (_client->start([this, what](Stream &s) {
+			if (what == FETCH_LOCATION)
+				on_locate(s);
+			else
+				on_connect(s, what);
+		}))
+		return true;
+
+	delete _client;
+	_client = 0;
+	return false;
+}
+
+uint8_t Provider::poll(struct Conditions &conditions, struct Forecast forecasts[], int days) {
+
+	if (!_client)
+		return 0;
+
+	int r = _client->poll();
+	if (r == JsonClient::BUSY)
+		return FETCH_PENDING;
+
+	// nothing outlives a parse, so whatever's left is lost
+	json_arena.reset();
+	uint8_t updated = 0;
+	_failed = r != JsonClient::READY;
+	if (!_failed)
+		switch (_fetching) {
+		case FETCH_CONDITIONS:
+			if (parse_conditions(*_client, conditions))
+				updated = FETCH_CONDITIONS;
+			break;
+		case FETCH_FORECASTS:
+			if (stream_forecasts(*_client, forecasts, days)) {
+				updated = FETCH_FORECASTS;
+				DBG(print(F("Done ")));
+			} else
+				_failed = true;
+			break;
+		case FETCH_LOCATION:
+			if (parse_location(*_client, conditions))
+				updated = FETCH_LOCATION;
+			else
+				_failed = true;
+			break;
+		default:
+			updated = parse_all(*_client, conditions, forecasts, days);
+			break;
 		}
+	if (_failed)
+		updated |= FETCH_FAILED;
+	_max_age = _client->max_age();
+	delete _client;
+	_client = 0;
+	return updated;
+}
+
+bool Provider::parse_conditions(Stream &s, struct Conditions &conditions) {
+
+	JsonDocument filter(&json_arena), doc(&json_arena);
+	conditions_filter(filter);
+	DeserializationError error = deserialize(doc, s, filter, stats.heap_conditions);
+	if (error) {
+		ERR(print(F("Deserialization of Conditions failed: ")));
+		ERR(println(error.f_str()));
+		return false;
 	}
-	wifi.stop();
+	bool ret = update_conditions(doc, conditions);
+	if (ret)
+		stats.num_updates++;
+	DBG(print(F("Done ")));
 	return ret;
 }
 
+uint8_t Provider::parse_all(Stream &s, struct Conditions &conditions, struct Forecast forecasts[], int days) {
+
+	JsonDocument filter(&json_arena), doc(&json_arena);
+	conditions_filter(filter);
+	forecasts_filter(filter);
+	DeserializationError error = deserialize(doc, s, filter, stats.heap_conditions);
+	if (error) {
+		ERR(print(F("Deserialization of Conditions and Forecasts failed: ")));
+		ERR(println(error.f_str()));
+		return 0;
+	}
+
+	uint8_t updated = 0;
+	if (update_conditions(doc, conditions)) {
+		updated |= FETCH_CONDITIONS;
+		stats.num_updates++;
+	}
+	if (update_forecasts(doc, forecasts, days))
+		updated |= FETCH_FORECASTS;
+	stats.heap_forecasts = stats.heap_conditions;
+	DBG(print(F("Done ")));
+	return updated;
+}
+
+bool Provider::stream_forecasts(Stream &s, struct Forecast forecasts[], int days) {
+
+	JsonDocument filter(&json_arena), doc(&json_arena);
+	forecasts_filter(filter);
+	DeserializationError error = deserialize(doc, s, filter, stats.heap_forecasts);
+	if (error) {
+		ERR(print(F("Deserialization of Forecasts failed: ")));
+		ERR(println(error.f_str()));
+		return false;
+	}
+	return update_forecasts(doc, forecasts, days);
+}
+
+// only the fields in the filter are kept, heap is set to the arena taken by the document;
+// one which doesn't fit in the arena fails as being out of memory
+DeserializationError Provider::deserialize(JsonDocument &doc, Stream &s, JsonDocument &filter, uint32_t &heap) {
+
+	uint32_t used = json_arena.used();
+	DeserializationError error = deserializeJson(doc, s, DeserializationOption::Filter(filter));
+	heap = json_arena.used() - used;
+	DBG(print(F("Document heap: ")));
+	DBG(println(heap));
+
+	if (error == DeserializationError::NoMemory || doc.overflowed())
+		stats.mem_failures++;
+	else if (error)
+		stats.parse_failures++;
+	if (error)
+		_failed = true;
+	return error;
+}
+
 // https://en.wikipedia.org/wiki/Lunar_phase#Calculating_phase
 int Provider::moon_age(time_t &epoch) {
 	const long last_full = 937008000;	// Aug 11, 1999
@@ -1,26 +1,73 @@
 #pragma once
 
+// what's being fetched
+#define FETCH_CONDITIONS	1
+#define FETCH_FORECASTS		2
+#define FETCH_LOCATION		4
+#define FETCH_FAILED		0x40
+#define FETCH_PENDING		0x80
+
 class Provider {
 public:
-	bool fetch_conditions(struct Conditions &c);
-	bool fetch_forecasts(struct Forecast f[], int days);
+	// starts fetching in the background, both in one request if it combines them
+	bool fetch(uint8_t what);
+	virtual bool combines() { return false; }
+	bool fetching() { return _client; }
+
+	// advances a fetch, returning FETCH_PENDING until it's done, then what was updated
+	uint8_t poll(struct Conditions &c, struct Forecast f[], int days);
+
+	// seconds the last response is fresh for, -1 if it didn't say
+	long max_age() { return _max_age; }
 
-	virtual void begin();
+	// from the location cache, looking it up if it's not there;
+	// false if it's needed and couldn't be found
+	bool begin();
+
+	// whether the cached location is due to be looked up again
+	bool location_stale();
+
+	// after the station changes, false if it needs looking up
+	bool relocate(struct Conditions &c);
 
 protected:
 	Provider(const __FlashStringHelper *host): _host(host) {}
 
-	virtual void on_connect(Stream &c, bool conds) = 0;
+	virtual void on_connect(Stream &c, uint8_t what) = 0;
+	virtual void conditions_filter(class JsonDocument &filter) = 0;
 	virtual bool update_conditions(class JsonDocument &doc, struct Conditions &c) = 0;
-	virtual bool update_forecasts(class JsonDocument &doc, struct Forecast f[], int days) = 0;
+
+	bool parse_conditions(Stream &s, struct Conditions &c);
+	uint8_t parse_all(Stream &s, struct Conditions &c, struct Forecast f[], int days);
+
+	// by default forecasts are parsed as one document, passed to update_forecasts()
+	virtual bool stream_forecasts(Stream &s, struct Forecast f[], int days);
+	virtual void forecasts_filter(class JsonDocument &filter) {}
+	virtual bool update_forecasts(class JsonDocument &doc, struct Forecast f[], int days) { return false; }
+
+	// the location is looked up by name, or from the IP address if nearest
+	virtual const __FlashStringHelper *locator();
+	virtual void on_locate(Stream &c);
+	virtual void location_filter(class JsonDocument &filter);
+	virtual bool update_location(class JsonDocument &doc, char *city, size_t n);
 
 	// utils
+	DeserializationError deserialize(class JsonDocument &doc, Stream &s, class JsonDocument &filter, uint32_t &heap);
 	int moon_age(time_t &epoch);
 	const char *moon_phase(int age);
 	const char *weather_description(int wmo_code);
 
 private:
 	const __FlashStringHelper *_host;
+	class JsonClient *_client = 0;
+	uint8_t _fetching;
+	bool _failed;
+	long _max_age = -1;
+	time_t _located;
+
+	bool parse_location(Stream &s, struct Conditions &c);
+	bool read_location(struct Conditions &c);
+	void write_location(struct Conditions &c);
 };
 
 class OpenWeatherMap: public Provider {
@@ -28,19 +75,28 @@ public:
 	OpenWeatherMap();
 
 protected:
-	void on_connect(Stream &c, bool conds);
+	void on_connect(Stream &c, uint8_t what);
+	void conditions_filter(class JsonDocument &filter);
 	bool update_conditions(class JsonDocument &doc, struct Conditions &c);
-	bool update_forecasts(class JsonDocument &doc, struct Forecast f[], int days);
+	bool stream_forecasts(Stream &s, struct Forecast f[], int days);
+	void forecasts_filter(class JsonDocument &filter);
 };
 
 class OpenMeteo: public Provider {
 public:
 	OpenMeteo();
 
-	void begin();
+	bool combines() { return true; }
 
 protected:
-	void on_connect(Stream &c, bool conds);
+	const __FlashStringHelper *locator();
+	void on_locate(Stream &c);
+	void location_filter(class JsonDocument &filter);
+	bool update_location(class JsonDocument &doc, char *city, size_t n);
+
+	void on_connect(Stream &c, uint8_t what);
+	void conditions_filter(class JsonDocument &filter);
 	bool update_conditions(class JsonDocument &doc, struct Conditions &c);
+	void forecasts_filter(class JsonDocument &filter);
 	bool update_forecasts(class JsonDocument &doc, struct Forecast f[], int days);
 };
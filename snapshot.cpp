@@ -0,0 +1,108 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "snapshot.h"
+#include "state.h"
+#include "dbg.h"
+
+#define SNAPSHOT_MAGIC		0x53475757	// "WWGS"
+#define SNAPSHOT_VERSION	1
+
+static const char *snapshot_file = "/snapshot.bin";
+static const char *snapshot_tmp = "/snapshot.tmp";
+
+// the structs are written as they are, so their sizes are checked as well
+// as the version and an incompatible snapshot is ignored
+struct header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t days;
+	uint16_t conditions, forecast, statistics;
+};
+
+static struct header make_header(int days) {
+	struct header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = SNAPSHOT_MAGIC;
+	h.version = SNAPSHOT_VERSION;
+	h.days = days;
+	h.conditions = sizeof(struct Conditions);
+	h.forecast = sizeof(struct Forecast);
+	h.statistics = sizeof(struct Statistics);
+	return h;
+}
+
+bool save_snapshot(struct Conditions &c, struct Forecast f[], int days, struct Statistics &s) {
+	uint32_t start = millis();
+	File file = LittleFS.open(snapshot_tmp, "w");
+	if (!file) {
+		ERR(println(F("Failed to create snapshot")));
+		return false;
+	}
+
+	struct header h = make_header(days);
+	size_t n = file.write((const uint8_t *)&h, sizeof(h));
+	n += file.write((const uint8_t *)&c, sizeof(c));
+	n += file.write((const uint8_t *)f, days * sizeof(*f));
+	n += file.write((const uint8_t *)&s, sizeof(s));
+	file.close();
+
+	// replaced only once it's complete
+	if (n != sizeof(h) + sizeof(c) + days * sizeof(*f) + sizeof(s) || !LittleFS.rename(snapshot_tmp, snapshot_file)) {
+		ERR(println(F("Failed to write snapshot")));
+		LittleFS.remove(snapshot_tmp);
+		return false;
+	}
+	DBG(print(F("Snapshot saved in ")));
+	DBG(print(millis() - start));
+	DBG(println(F("ms")));
+	return true;
+}
+
+// after the config changes it may be for somewhere else, or in other units
+void discard_snapshot() {
+	LittleFS.remove(snapshot_file);
+}
+
+// only the counts and the ages of observations carry over a restart: the
+// rest are times from millis(), or describe the last boot or response
+static void restore_statistics(struct Statistics &s, const struct Statistics &saved) {
+	memset(&s, 0, sizeof(s));
+	s.last_age = saved.last_age;
+	s.min_age = saved.min_age;
+	s.max_age = saved.max_age;
+	s.total = saved.total;
+	s.num_updates = saved.num_updates;
+	s.connect_failures = saved.connect_failures;
+	s.http_requests = saved.http_requests;
+	s.http_connects = saved.http_connects;
+	s.parse_failures = saved.parse_failures;
+	s.mem_failures = saved.mem_failures;
+	s.icon_hits = saved.icon_hits;
+	s.icon_misses = saved.icon_misses;
+	s.icon_evictions = saved.icon_evictions;
+}
+
+bool restore_snapshot(struct Conditions &c, struct Forecast f[], int days, struct Statistics &s) {
+	File file = LittleFS.open(snapshot_file, "r");
+	if (!file)
+		return false;
+
+	struct header h, expected = make_header(days);
+	struct Statistics saved;
+	bool ok = file.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && !memcmp(&h, &expected, sizeof(h))
+		&& file.read((uint8_t *)&c, sizeof(c)) == sizeof(c)
+		&& file.read((uint8_t *)f, days * sizeof(*f)) == days * sizeof(*f)
+		&& file.read((uint8_t *)&saved, sizeof(saved)) == sizeof(saved);
+	file.close();
+
+	if (!ok) {
+		ERR(println(F("Ignoring incompatible snapshot")));
+		memset(&c, 0, sizeof(c));
+		memset(f, 0, days * sizeof(*f));
+		return false;
+	}
+	restore_statistics(s, saved);
+	c.stale = true;
+	return true;
+}
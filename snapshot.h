@@ -0,0 +1,6 @@
+#pragma once
+
+// the last weather fetched, shown at boot until it's fetched again
+bool save_snapshot(struct Conditions &c, struct Forecast f[], int days, struct Statistics &s);
+bool restore_snapshot(struct Conditions &c, struct Forecast f[], int days, struct Statistics &s);
+void discard_snapshot();
@@ -2,6 +2,8 @@
 
 struct Conditions {
 	time_t epoch;
+	int interval;	// between observations, if known
+	bool stale;	// restored at boot and not fetched since
 	char city[48];
 	char icon[16];
 	char weather[32];
@@ -37,8 +39,17 @@ struct Statistics {
 	uint32_t last_fetch_conditions, last_fetch_forecasts;
 	unsigned num_updates;
 	unsigned connect_failures;
+	unsigned http_requests, http_connects;	// connects < requests when kept alive
+	uint32_t rx_bytes, inflated_bytes, inflate_us;	// of the last response
+	uint32_t max_loop_ms;	// while fetching
 	unsigned parse_failures;
 	unsigned mem_failures;
+	uint32_t heap_conditions, heap_forecasts;	// taken by the last documents
+	unsigned icon_hits, icon_misses, icon_evictions;
+	uint32_t paint_ms[7];	// last time to paint each screen
+	uint32_t first_frame_ms;	// from boot to showing the weather
+	uint32_t wifi_connect_ms;
+	bool wifi_fast;	// connected without a scan
 
 	void update(time_t age) {
 		last_age = age;
@@ -48,6 +59,12 @@ struct Statistics {
 		if (age < min_age || !min_age)
 			min_age = age;
 	}
+
+	// percent of icons drawn from the cache
+	unsigned icon_hit_rate() const {
+		unsigned n = icon_hits + icon_misses;
+		return n? 100 * icon_hits / n: 0;
+	}
 };
 
 extern struct Statistics stats;
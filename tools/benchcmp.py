@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+#
+# Compares two sets of results from make native-bench, e.g., from the last
+# release and now, listing the scenarios which got slower or use more memory.
+#
+# A scenario has regressed if its median time grew by more than the threshold,
+# or if it allocates more often or its heap peak grew at all (these don't vary
+# from run to run as times do). Exits with 1 if any regressed.
+#
+# usage: benchcmp.py [-t percent] old.json new.json
+
+import argparse
+import json
+import sys
+
+MEMORY = ('allocs', 'heap_peak', 'doc_heap')
+
+
+def load(path):
+	with open(path) as f:
+		return {s['name']: s for s in json.load(f)['scenarios']}
+
+
+def change(old, new):
+	return 100.0 * (new - old) / old if old else 0.0
+
+
+def main():
+	p = argparse.ArgumentParser(description='Compare benchmark results')
+	p.add_argument('-t', '--threshold', type=float, default=10.0,
+		help='percentage by which the median may grow (default 10)')
+	p.add_argument('old')
+	p.add_argument('new')
+	args = p.parse_args()
+
+	old, new = load(args.old), load(args.new)
+	regressed = 0
+	for name in sorted(set(old) | set(new)):
+		if name not in new:
+			print('%-28s removed' % name)
+			continue
+		if name not in old:
+			print('%-28s added' % name)
+			continue
+		o, n = old[name], new[name]
+		notes = []
+		if n['failed'] > o['failed']:
+			notes.append('%d failed' % n['failed'])
+		d = change(o['p50_us'], n['p50_us'])
+		if d > args.threshold:
+			notes.append('p50 %+.0f%%' % d)
+		for k in MEMORY:
+			if n.get(k, 0) > o.get(k, 0):
+				notes.append('%s %d -> %d' % (k, o.get(k, 0), n[k]))
+		print('%-28s %8d -> %8d us %+6.1f%%  %s' % (name, o['p50_us'], n['p50_us'], d, ', '.join(notes)))
+		if notes:
+			regressed += 1
+
+	if regressed:
+		print('%d regressed' % regressed, file=sys.stderr)
+	return 1 if regressed else 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+#
+# Packs 24-bit BMP icons into a single indexed file read by display_bmp().
+#
+# All values are little-endian:
+#   header:	"IP", count (16 bits)
+#   index:	count entries of name (12 bytes, NUL-padded), offset (32 bits),
+#		sorted by name
+#   icon:	width, height, colours (16 bits each), palette of colours
+#		RGB565 values, then run-length encoded pixels, row after row.
+#
+# Pixels are palette indices (one byte) or, for icons with too many colours
+# for a palette (colours = 0), RGB565 values. Runs are introduced by a byte
+# n: if n & 0x80 the next pixel is repeated (n & 0x7f) + 1 times, otherwise
+# n + 1 literal pixels follow.
+#
+# usage: iconpack.py -o icons.pak foo.bmp ...
+
+import argparse
+import os
+import struct
+import sys
+
+NAME_LEN = 12
+MAX_RUN = 128
+
+
+def read_bmp(path):
+	with open(path, 'rb') as f:
+		b = f.read()
+	if b[:2] != b'BM':
+		raise ValueError('%s: unknown BMP signature' % path)
+	offset, = struct.unpack_from('<I', b, 10)
+	w, h, planes, depth, compression = struct.unpack_from('<iiHHI', b, 18)
+	if planes != 1 or depth != 24 or compression != 0:
+		raise ValueError('%s: BMP format not recognized' % path)
+	row_size = (w * 3 + 3) & ~3
+	rows = []
+	for r in range(abs(h)):
+		p = offset + r * row_size
+		rows.append([(b[p + 3*x + 2], b[p + 3*x + 1], b[p + 3*x]) for x in range(w)])
+	# BMP rows are stored bottom-up unless the height is negative
+	if h > 0:
+		rows.reverse()
+	return w, abs(h), rows
+
+
+def rgb565(r, g, b):
+	return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3)
+
+
+def encode(pixels, fmt):
+	out = bytearray()
+	i, n = 0, len(pixels)
+	literals = []
+
+	def flush():
+		if literals:
+			out.append(len(literals) - 1)
+			for p in literals:
+				out.extend(struct.pack(fmt, p))
+			literals.clear()
+
+	while i < n:
+		run = 1
+		while i + run < n and run < MAX_RUN and pixels[i + run] == pixels[i]:
+			run += 1
+		if run > 1:
+			flush()
+			out.append(0x80 | (run - 1))
+			out.extend(struct.pack(fmt, pixels[i]))
+			i += run
+		else:
+			literals.append(pixels[i])
+			if len(literals) == MAX_RUN:
+				flush()
+			i += 1
+	flush()
+	return bytes(out)
+
+
+def pack_icon(path):
+	w, h, rows = read_bmp(path)
+	pixels = [rgb565(*p) for row in rows for p in row]
+	palette = sorted(set(pixels))
+	out = bytearray()
+	if len(palette) <= 256:
+		index = {c: i for i, c in enumerate(palette)}
+		out.extend(struct.pack('<HHH', w, h, len(palette)))
+		out.extend(struct.pack('<%dH' % len(palette), *palette))
+		out.extend(encode([index[p] for p in pixels], '<B'))
+	else:
+		out.extend(struct.pack('<HHH', w, h, 0))
+		out.extend(encode(pixels, '<H'))
+	return bytes(out)
+
+
+def main():
+	p = argparse.ArgumentParser(description='Pack 24-bit BMPs into an icon pack')
+	p.add_argument('-o', '--output', default='icons.pak')
+	p.add_argument('bmps', nargs='+')
+	args = p.parse_args()
+
+	icons = {}
+	for bmp in args.bmps:
+		name = os.path.splitext(os.path.basename(bmp))[0].encode()
+		if len(name) >= NAME_LEN:
+			print('%s: name too long' % bmp, file=sys.stderr)
+			return 1
+		try:
+			icons[name] = pack_icon(bmp)
+		except ValueError as e:
+			print(e, file=sys.stderr)
+			return 1
+
+	names = sorted(icons)
+	offset = 4 + len(names) * (NAME_LEN + 4)
+	with open(args.output, 'wb') as f:
+		f.write(b'IP')
+		f.write(struct.pack('<H', len(names)))
+		for name in names:
+			f.write(struct.pack('<%dsI' % NAME_LEN, name, offset))
+			offset += len(icons[name])
+		for name in names:
+			f.write(icons[name])
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
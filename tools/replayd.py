@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+#
+# Serves recorded responses in place of the weather and location services,
+# so fetches can be tested without the internet and under bad conditions.
+#
+# Point the device, or make native-run, at it by setting "server" (and
+# "server_port") in config.json, or with wwg -S host:port. Requests still
+# carry the real Host, and are answered from dir/host/path, ignoring the
+# query, e.g. native/replay/api.open-meteo.com/v1/forecast. A file which
+# starts with "HTTP/1." is sent as it is, anything else as JSON.
+#
+# Faults are injected into a proportion of the responses:
+#   --error		a 5xx page
+#   --slow		nothing for --slow-ms, to run out JsonClient's timeout
+#   --disconnect	the connection is closed partway through the body
+# and every response can be delayed, trickled, chunked or gzipped.
+#
+# Requests are counted by host, path and what was done to them; the counts
+# are served as JSON from /_stats and printed when it's stopped.
+#
+# usage: replayd.py [-d dir] [-p port] [--latency ms] [--bandwidth bytes/s]
+#		[--chunked] [--gzip] [--error p] [--slow p] [--disconnect p] ...
+
+import argparse
+import collections
+import email.utils
+import gzip
+import json
+import os
+import random
+import signal
+import socket
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+ERROR_PAGE = b'<html><head><title>%d %s</title></head><body><h1>%d %s</h1></body></html>\n'
+TRICKLE_MS = 50
+
+
+class Stats:
+	def __init__(self):
+		self.lock = threading.Lock()
+		self.requests = collections.Counter()
+		self.outcomes = collections.Counter()
+
+	def count(self, key, outcomes):
+		with self.lock:
+			self.requests[key] += 1
+			self.outcomes.update(outcomes)
+
+	def json(self):
+		with self.lock:
+			return {
+				'requests': dict(self.requests),
+				'outcomes': dict(self.outcomes),
+				'total': sum(self.requests.values()),
+			}
+
+
+class Handler(BaseHTTPRequestHandler):
+	protocol_version = 'HTTP/1.1'
+
+	def log_message(self, fmt, *args):
+		if not self.server.args.quiet:
+			sys.stderr.write('%s %s\n' % (self.log_date_time_string(), fmt % args))
+
+	def do_GET(self):
+		args = self.server.args
+		host = self.headers.get('Host', '').split(':')[0]
+		path = self.path.split('?')[0]
+
+		if path == '/_stats':
+			self.send_json(json.dumps(self.server.stats.json(), indent=1).encode())
+			return
+
+		key = host + path
+		body = self.server.lookup(host, path)
+		if body is None:
+			self.server.stats.count(key, ['not_found'])
+			self.send_error_page(404, 'Not Found')
+			return
+
+		if args.latency or args.jitter:
+			time.sleep((args.latency + random.uniform(0, args.jitter)) / 1000.0)
+
+		if random.random() < args.error:
+			self.server.stats.count(key, ['error'])
+			self.send_error_page(random.choice((500, 502, 503)), 'Server Error')
+			return
+
+		faults = []
+		if random.random() < args.slow:
+			faults.append('slow')
+			time.sleep(args.slow_ms / 1000.0)
+
+		if body.startswith(b'HTTP/1.'):
+			self.server.stats.count(key, faults + ['raw'])
+			self.trickle(body)
+			self.close_connection = True
+			return
+
+		headers = [('Content-Type', 'application/json'), ('Date', email.utils.formatdate(usegmt=True))]
+		if args.max_age is not None:
+			headers.append(('Cache-Control', 'max-age=%d' % args.max_age))
+		if args.gzip and 'gzip' in self.headers.get('Accept-Encoding', ''):
+			body = gzip.compress(body)
+			headers.append(('Content-Encoding', 'gzip'))
+
+		cut = None
+		if random.random() < args.disconnect:
+			cut = random.randint(1, max(1, len(body) - 1))
+			faults.append('disconnect')
+		self.server.stats.count(key, faults or ['ok'])
+
+		self.send_response(200)
+		for h, v in headers:
+			self.send_header(h, v)
+		if args.chunked:
+			self.send_header('Transfer-Encoding', 'chunked')
+		else:
+			self.send_header('Content-Length', str(len(body)))
+		self.end_headers()
+		self.wfile.flush()
+
+		data = body if cut is None else body[:cut]
+		if args.chunked:
+			n = args.chunk_size
+			data = b''.join(b'%x\r\n%s\r\n' % (len(data[i:i + n]), data[i:i + n]) for i in range(0, len(data), n))
+			if cut is None:
+				data += b'0\r\n\r\n'
+		self.trickle(data)
+
+		if cut is not None:
+			self.close_connection = True
+			self.connection.shutdown(socket.SHUT_RDWR)
+
+	# at most --bandwidth bytes a second
+	def trickle(self, data):
+		rate = self.server.args.bandwidth
+		if not rate:
+			self.wfile.write(data)
+			self.wfile.flush()
+			return
+		n = max(1, rate * TRICKLE_MS // 1000)
+		for i in range(0, len(data), n):
+			self.wfile.write(data[i:i + n])
+			self.wfile.flush()
+			time.sleep(TRICKLE_MS / 1000.0)
+
+	def send_json(self, body):
+		self.send_response(200)
+		self.send_header('Content-Type', 'application/json')
+		self.send_header('Content-Length', str(len(body)))
+		self.end_headers()
+		self.wfile.write(body)
+
+	def send_error_page(self, code, reason):
+		body = ERROR_PAGE % (code, reason.encode(), code, reason.encode())
+		self.send_response(code)
+		self.send_header('Content-Type', 'text/html')
+		self.send_header('Content-Length', str(len(body)))
+		self.end_headers()
+		self.wfile.write(body)
+
+
+class Server(ThreadingHTTPServer):
+	daemon_threads = True
+
+	def __init__(self, args):
+		super().__init__((args.bind, args.port), Handler)
+		self.args = args
+		self.stats = Stats()
+
+	# by Host, or by path alone if the Host isn't recorded, e.g. from curl
+	def lookup(self, host, path):
+		root = os.path.realpath(self.args.dir)
+		names = [os.path.join(root, host, path.lstrip('/'))] if host else []
+		names += [os.path.join(root, h, path.lstrip('/')) for h in sorted(os.listdir(root))]
+		for name in names:
+			name = os.path.realpath(name)
+			if name.startswith(root + os.sep) and os.path.isfile(name):
+				with open(name, 'rb') as f:
+					return f.read()
+		return None
+
+
+def main():
+	p = argparse.ArgumentParser(description='Serve recorded weather responses, with faults')
+	p.add_argument('-d', '--dir', default='native/replay', help='recorded responses, by host and path')
+	p.add_argument('-b', '--bind', default='', help='address to listen on (default all)')
+	p.add_argument('-p', '--port', type=int, default=8080)
+	p.add_argument('-q', '--quiet', action='store_true', help="don't log requests")
+	p.add_argument('--seed', type=int, help='for repeatable faults')
+	p.add_argument('--latency', type=int, default=0, help='ms before responding')
+	p.add_argument('--jitter', type=int, default=0, help='up to this many more ms')
+	p.add_argument('--bandwidth', type=int, default=0, help='bytes/s, 0 for unlimited')
+	p.add_argument('--chunked', action='store_true', help='send bodies chunked')
+	p.add_argument('--chunk-size', type=int, default=256)
+	p.add_argument('--gzip', action='store_true', help='compress bodies if asked to')
+	p.add_argument('--max-age', type=int, help='seconds for Cache-Control')
+	p.add_argument('--error', type=float, default=0, help='proportion of 5xx responses')
+	p.add_argument('--slow', type=float, default=0, help='proportion with a slow first byte')
+	p.add_argument('--slow-ms', type=int, default=6000)
+	p.add_argument('--disconnect', type=float, default=0, help='proportion cut off mid-body')
+	args = p.parse_args()
+
+	if not os.path.isdir(args.dir):
+		print('%s: not a directory' % args.dir, file=sys.stderr)
+		return 1
+	if args.seed is not None:
+		random.seed(args.seed)
+
+	server = Server(args)
+	signal.signal(signal.SIGTERM, lambda *_: sys.exit())
+	print('Serving %s on port %d' % (args.dir, args.port), file=sys.stderr)
+	try:
+		server.serve_forever()
+	except (KeyboardInterrupt, SystemExit):
+		pass
+	server.server_close()
+	print(json.dumps(server.stats.json(), indent=1))
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# Generates the responses in native/replay which make native-run, the soak
+# and replayd.py serve.
+#
+# They're synthetic, like those in native/bench: a day's weather for Dublin
+# made up by hand, and the OWM forecast's values drawn from a fixed seed, so
+# the same files come out every time. The soak moves the observation times
+# on as it runs; everything else is as it's written here.
+#
+# usage: replaygen.py [-o dir]
+
+import argparse
+import json
+import os
+import random
+
+from benchgen import DAY0, NOW, SUNRISE, SUNSET, ip_api, owm_forecast, owm_weather
+
+
+def write(out, path, obj):
+	p = os.path.join(out, path)
+	os.makedirs(os.path.dirname(p), exist_ok=True)
+	with open(p, 'w') as f:
+		f.write(json.dumps(obj, separators=(',', ':'), ensure_ascii=False) + '\n')
+
+
+def openmeteo():
+	days = 7
+	d = {
+		'time': [DAY0 + 86400*i for i in range(days)],
+		'weather_code': [3, 61, 80, 2, 63, 1, 45],
+		'temperature_2m_max': [14.2, 13.1, 12.8, 15.0, 11.9, 13.4, 12.2],
+		'temperature_2m_min': [8.1, 9.4, 7.6, 6.9, 8.8, 5.2, 6.4],
+		'apparent_temperature_max': [12.0, 10.9, 10.1, 13.2, 9.0, 11.8, 10.5],
+		'apparent_temperature_min': [5.3, 6.8, 4.4, 4.1, 5.9, 2.6, 3.9],
+		'sunrise': [SUNRISE + 120*i for i in range(days)],
+		'sunset': [SUNSET - 180*i for i in range(days)],
+		'wind_speed_10m_max': [24.1, 31.7, 28.4, 15.2, 35.6, 18.0, 12.3],
+		'wind_gusts_10m_max': [48.2, 61.9, 55.1, 30.6, 70.2, 37.4, 25.9],
+		'wind_direction_10m_dominant': [232, 214, 251, 280, 198, 305, 160],
+	}
+	return {
+		'latitude': 53.34, 'longitude': -6.26, 'generationtime_ms': 0.0629425048828125,
+		'utc_offset_seconds': 3600, 'timezone': 'Europe/Dublin',
+		'timezone_abbreviation': 'IST', 'elevation': 8.0,
+		'current_units': {
+			'time': 'unixtime', 'interval': 'seconds', 'temperature_2m': '°C',
+			'relative_humidity_2m': '%', 'apparent_temperature': '°C', 'is_day': '',
+			'weather_code': 'wmo code', 'surface_pressure': 'hPa',
+			'wind_speed_10m': 'km/h', 'wind_direction_10m': '°',
+		},
+		'current': {
+			'time': NOW, 'interval': 900, 'temperature_2m': 12.3,
+			'relative_humidity_2m': 81, 'apparent_temperature': 10.9, 'is_day': 1,
+			'weather_code': 3, 'surface_pressure': 1012.4, 'wind_speed_10m': 14.8,
+			'wind_direction_10m': 232,
+		},
+		'hourly_units': {'time': 'unixtime', 'temperature_2m': '°C'},
+		'hourly': {'time': [], 'temperature_2m': []},
+		'daily_units': {
+			'time': 'unixtime', 'weather_code': 'wmo code', 'temperature_2m_max': '°C',
+			'temperature_2m_min': '°C', 'apparent_temperature_max': '°C',
+			'apparent_temperature_min': '°C', 'sunrise': 'unixtime', 'sunset': 'unixtime',
+			'wind_speed_10m_max': 'km/h', 'wind_gusts_10m_max': 'km/h',
+			'wind_direction_10m_dominant': '°',
+		},
+		'daily': d,
+	}
+
+
+def geocoding():
+	dublin = {
+		'id': 2964574, 'name': 'Dublin', 'latitude': 53.33306, 'longitude': -6.24889,
+		'elevation': 17.0, 'feature_code': 'PPLC', 'country_code': 'IE',
+		'admin1_id': 7288564, 'timezone': 'Europe/Dublin', 'population': 1024027,
+		'country_id': 2963597, 'country': 'Ireland', 'admin1': 'Leinster',
+	}
+	return {'results': [dublin], 'generationtime_ms': 0.6479025}
+
+
+def main():
+	p = argparse.ArgumentParser(description='Generate the replayed responses')
+	p.add_argument('-o', '--out', default='native/replay', help='directory to write them to')
+	args = p.parse_args()
+
+	# only the forecast's values are drawn; the rest take the benchmark's
+	# medium responses as they are
+	random.seed(1)
+	write(args.out, 'api.open-meteo.com/v1/forecast', openmeteo())
+	write(args.out, 'geocoding-api.open-meteo.com/v1/search', geocoding())
+	write(args.out, 'ip-api.com/json', ip_api()[1])
+	write(args.out, 'api.openweathermap.org/data/2.5/weather', owm_weather()[1])
+	write(args.out, 'api.openweathermap.org/data/2.5/forecast', owm_forecast(40))
+
+
+if __name__ == '__main__':
+	main()